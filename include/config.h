@@ -11,9 +11,10 @@
 
 // --- ESCUDO PARA VS CODE ---
 // VS Code no entiende los #pragma de Microchip y marca error.
-// Con este #ifndef, le decimos que ignore estas líneas en el editor.
+// Con este #if, le decimos que ignore estas líneas en el editor.
 // El compilador (XC8) SÍ las leerá y configurará el PIC correctamente.
-#ifndef __INTELLISENSE__
+// El simulador de host (sim/) tampoco las necesita: define SIMULADOR.
+#if !defined(__INTELLISENSE__) && !defined(SIMULADOR)
 
     // CONFIG1H
     [cite_start]#pragma config OSC = HS      // Oscilador externo de alta velocidad [cite: 19]
@@ -27,7 +28,7 @@
 
     // CONFIG2H
     [cite_start]#pragma config WDT = OFF     // Watchdog Timer apagado [cite: 29]
-    [cite_start]#pragma config WDTPS = 2048  // Postscaler WDT [cite: 29]
+    #pragma config WDTPS = 16    // Postscaler WDT: ~65 ms por despertar (SWDTEN en bajo consumo)
 
     // CONFIG3H
     [cite_start]#pragma config CCP2MX = PORTC // CCP2 en RC1 [cite: 31]
@@ -55,7 +56,7 @@
     #pragma config EBTR1 = OFF
     #pragma config EBTRB = OFF
 
-#endif // Fin del escudo __INTELLISENSE__
+#endif // Fin del escudo __INTELLISENSE__ / SIMULADOR
 
 // Incluimos el parche de definiciones para el resto del código
 #include "vscode_fix.h"
@@ -8,6 +8,7 @@
 #define GLOBAL_VARS_H
 
 #include <stdint.h>
+#include "opciones.h"
 
 // --- MÁSCARAS DE BITS PID (Registro pidStat1) [cite: 258-260] ---
 #define PID_ERR_Z       (1 << 0) // Error actual es cero
@@ -28,17 +29,106 @@
 #define LSB 0
 #define MSB 7
 
+// --- CONSTANTES PID ---
+#define derivCountVal   10      // Ciclos entre cálculos del término derivativo
+#define derivCountRecarga (derivCountVal * PID_POR_CICLO) // En actualizaciones del PID
+#define A_ERR_LIM_H     0xC3    // Límite del error acumulado: 0xC350 = 50000
+#define A_ERR_LIM_L     0x50
+
+// --- GENERACIÓN ---
+#define PUNTOS_SENO     98      // Puntos de SINE_TABLE por semiciclo
+
 // --- DEFINICIONES DE PINES [cite: 274-288] ---
 #define V_BAT       PORTAbits.RA4
-#define AHORRO      PORTBbits.RB0
+#define AHORRO      PORTCbits.RC6   // Llave de Bajo Consumo (antes en RB0)
+#define FALLA_HW    PORTBbits.RB0   // Estado del FF de protección, 0 = falla (INT0)
 #define AIRE        LATBbits.LATB4
 #define BUZZER      LATBbits.LATB5
 #define LECTURA     LATBbits.LATB6
 #define SYNC_OSC    LATBbits.LATB7
+#define SYNC_ENTRADA PORTBbits.RB7  // Esclavo: pulso de inicio de ciclo del maestro
 #define SPI_SCK     LATCbits.LATC3
 #define SPI_SDI     LATCbits.LATC4
 #define SPI_SDO     LATCbits.LATC5
 
+// --- ESPERA ACTIVA ---
+// En el PIC no genera código. El simulador de host (sim/) lo usa para avanzar
+// un tick de Timer2 mientras el firmware espera un evento de hardware.
+#ifdef SIMULADOR
+void sim_tick(void);
+#define ESPERA_TICK()   sim_tick()
+#else
+#define ESPERA_TICK()
+#endif
+
+// --- PUNTOS DE TRAZA (opciones.h) ---
+// Con TRAZA_PINES el número es la cantidad de pulsos: los más frecuentes van primero
+#define TP_ISR          1
+#define TP_ISR_FIN      2
+#define TP_CICLO        3       // K = 0 en el bucle principal
+#define TP_PID          4
+#define TP_PID_FIN      5
+#define TP_I_SALIDA     6
+#define TP_I_SALIDA_FIN 7
+#define TP_TEMPERAT     8
+#define TP_TEMPERAT_FIN 9
+#define TP_ENVIAR       10
+#define TP_ENVIAR_FIN   11
+#define TP_ENCENDER     12
+#define TP_APAGAR       13
+#define TP_APAGAR_1     14
+#define TP_PRUEBA       15
+#define TP_OUT_FIJA     16
+
+#if TRAZA_MODO == TRAZA_PINES
+#define TRAZA_PULSOS(id)    do { uint8_t n_ = (id); do { LECTURA = 1; LECTURA = 0; } while (--n_); } while (0)
+#define TRAZA(id)           do { uint8_t g_ = PIE1bits.TMR2IE; PIE1bits.TMR2IE = 0; \
+                                 TRAZA_PULSOS(id); PIE1bits.TMR2IE = g_; } while (0)
+#define TRAZA_ISR(id)       TRAZA_PULSOS(id)
+#define MARCA_LECTURA(x)    ((void)0)           // RB6 es el pin de traza
+#elif TRAZA_MODO == TRAZA_SPI
+#define TRAZA_REGISTRO(id)  do { volatile uint8_t *r_ = TRAZA_BUF[TRAZA_ENTRA]; \
+                                 r_[0] = (uint8_t)((id) | ((NN - 1) << 7)); \
+                                 r_[1] = (uint8_t)(CICLO_0 + ((K & 0x01) ? PUNTOS_SENO : 0)); \
+                                 r_[2] = TMR2; \
+                                 TRAZA_ENTRA = (TRAZA_ENTRA + 1) & (TRAZA_REGISTROS - 1); \
+                                 if (TRAZA_N < TRAZA_REGISTROS) TRAZA_N++; \
+                                 else if (TRAZA_PERDIDOS < 255) TRAZA_PERDIDOS++; } while (0)
+#define TRAZA(id)           do { uint8_t g_ = PIE1bits.TMR2IE; PIE1bits.TMR2IE = 0; \
+                                 TRAZA_REGISTRO(id); PIE1bits.TMR2IE = g_; } while (0)
+#define TRAZA_ISR(id)       TRAZA_REGISTRO(id)
+#define MARCA_LECTURA(x)    (LECTURA = (x))
+#else
+#define TRAZA(id)           ((void)0)
+#define TRAZA_ISR(id)       ((void)0)
+#define MARCA_LECTURA(x)    (LECTURA = (x))
+#endif
+
+// Marca de inicio de ciclo en SYNC_OSC para el osciloscopio. Con SINCRONISMO la
+// línea es del sincronismo (la maneja la ISR del maestro) y no se marca.
+#if SINCRONISMO == SINC_LIBRE
+#define MARCA_CICLO(x)      (SYNC_OSC = (x))
+#else
+#define MARCA_CICLO(x)      ((void)0)
+#endif
+
+// --- TIEMPOS DE LAS TAREAS (opciones.h) ---
+// TAREA_FIN() mide desde el TAREA_INICIO() o TAREA_FIN() anterior
+#if MEDIR_TAREAS
+#define TAREA_INICIO()      (T_TAREA = leer_timer1())
+#define TAREA_FIN(n)        (T_TAREA = medir_tarea((n), T_TAREA))
+#else
+#define TAREA_INICIO()      ((void)0)
+#define TAREA_FIN(n)        ((void)0)
+#endif
+
+// Referencia del PID: con PARALELO, la de la caída (caida_paralelo())
+#if PARALELO
+#define REF_PID             REF_CAIDA
+#else
+#define REF_PID             REF_ERR
+#endif
+
 // --- VARIABLES EXTERNAS (Volatile) ---
 // (Lista idéntica a la anterior para compatibilidad)
 extern volatile uint8_t V_PICO_0; extern volatile uint8_t V_PICO_1;
@@ -55,6 +145,9 @@ extern volatile uint8_t REF_ERR;
 extern volatile uint8_t REF0; extern volatile uint8_t REF1;
 extern volatile uint8_t U; extern volatile uint8_t U_0; extern volatile uint8_t U_1;
 extern volatile uint8_t kp; extern volatile uint8_t ki; extern volatile uint8_t kd;
+extern volatile uint8_t AJUSTADO;       // 1 = autoajuste hecho (o no pedido)
+extern volatile uint8_t AUTO_INTENTADO; // 1 = la prueba terminó sin medición en este arranque
+extern volatile uint8_t kp_nom; extern volatile uint8_t ki_nom; extern volatile uint8_t kd_nom;
 
 // PID Variables Internas
 extern volatile uint8_t error0; extern volatile uint8_t error1;
@@ -69,11 +162,91 @@ extern volatile uint8_t pidStat1; extern volatile uint8_t pidStat2;
 extern volatile uint8_t percent_err;
 extern volatile uint8_t derivCount;
 
+// Control repetitivo (Q4, cuentas de duty por índice de SINE_TABLE)
+#if REPETITIVO
+extern volatile int16_t CORRECCION[PUNTOS_SENO];
+extern volatile int8_t ERROR_REP[PUNTOS_SENO];  // Error del último ciclo por índice
+#endif
+extern volatile uint8_t REP_INDICE;     // Último índice muestreado
+extern volatile uint8_t TM_ADELANTO;    // Adelanto de la corriente del puente [índices]
+extern volatile uint8_t TM_PENDIENTE;    // Corriente pico / rizado del puente (Q4)
+extern volatile int8_t OBS_V;           // Cuentas de V_PICO sumadas al PID (OBSERVADOR_CARGA)
+extern volatile uint8_t OBS_I_ANT;      // I_SALIDA del ciclo anterior
+extern volatile uint8_t OBS_SIN_REF;    // 1 = predicción entrando (al encender o tras PP)
+extern volatile uint8_t PID_TRAMO;      // Próxima actualización del PID en el ciclo
+extern volatile uint8_t VBAT_AD;        // Batería en el divisor de 32 V (PREALIM_VBAT)
+extern volatile uint8_t VBAT_LEIDA;     // Ya se midió en este ciclo
+extern volatile uint16_t ISR_TCY;       // Peor duración de la ISR de Timer2 [Tcy] (MEDIR_ISR)
+extern volatile uint8_t V_SINC;         // AN0 tomada por la ISR en AD_INDICE_V (AD_SINCRONO)
+extern volatile uint8_t I_SINC;         // Mayor AN1 tomada por la ISR desde la última lectura
+extern volatile uint8_t AD_LISTO;       // Lecturas de la ISR sin usar (AD_LISTO_V, AD_LISTO_I)
+#define AD_LISTO_V      (1 << 0)
+#define AD_LISTO_I      (1 << 1)
+#define AD_LISTO_FASE   (1 << 2)
+#if AD_SINCRONO
+extern volatile uint8_t AD_ISR;         // Conversión de la ISR sin recoger (AD_ISR_*, 0 = A/D libre)
+#endif
+#define AD_ISR_V        1
+#define AD_ISR_I        2
+#define AD_ISR_FASE1    3               // FASE_INDICE (PARALELO)
+#define AD_ISR_FASE2    4               // PUNTOS_SENO - FASE_INDICE
+#define THD_BINS        ((THD_ARMONICO_MAX + 1) / 2)    // Fundamental y armónicos impares
+#if THD_GOERTZEL
+extern volatile int32_t THD_S1[THD_BINS]; extern volatile int32_t THD_S2[THD_BINS]; // Resonadores
+#endif
+extern volatile uint8_t THD_J;          // Próxima muestra del semiciclo (0..13, 14 = hecho)
+extern volatile uint8_t THD_N;          // Ciclos acumulados en el bloque
+extern volatile uint8_t THD_FIN;        // Bloque completo, falta calcular
+extern volatile uint8_t THD_X10;        // THD de la salida en 0,1 % (THD_GOERTZEL)
+extern volatile uint32_t CICLOS;        // Ciclos de 50 Hz generados desde el arranque
+extern volatile uint8_t EV_PERDIDOS;    // Eventos descartados con la cola llena
+extern volatile uint8_t PAR_CARGADOS;   // 1 = parámetros tomados de la EEPROM
+extern volatile uint16_t T_ARRANQUE[ARR_FASES]; // Timer0 al terminar cada fase del arranque
+extern volatile uint8_t ARR_MARCAS;     // Fases ya marcadas (bit por fase)
+extern volatile uint8_t ARR_ENVIADA;    // La línea de tiempo ya salió en una trama
+extern volatile uint8_t TRAZA_BUF[TRAZA_REGISTROS][3]; // Anillo de TRAZA_SPI
+extern volatile uint8_t TRAZA_ENTRA;    // Próximo registro a escribir
+extern volatile uint8_t TRAZA_N;        // Registros sin enviar
+extern volatile uint8_t TRAZA_PERDIDOS; // Pisados antes de enviarse
+extern volatile uint16_t HIST_MIN[TAREAS]; extern volatile uint16_t HIST_MAX[TAREAS]; // Cuentas de Timer1
+extern volatile uint16_t HIST_CUENTAS[TAREAS][HIST_CUBETAS];
+extern volatile uint16_t T_TAREA;       // Timer1 al terminar la tarea anterior
+extern volatile uint16_t T_CICLO;       // Timer1 al empezar el ciclo
+extern volatile uint8_t HOLGURA_CERO;   // Ciclos desbordados (MEDIR_TAREAS)
+extern volatile uint8_t HIST_ENVIO;     // Próxima tarea a enviar
+extern volatile uint8_t RES_MIN[RES_VARIABLES]; extern volatile uint8_t RES_MAX[RES_VARIABLES];
+extern volatile uint32_t RES_SUMA[RES_VARIABLES];
+extern volatile uint16_t RES_CUENTAS[RES_CUBETAS];  // Histograma de I_SALIDA
+extern volatile uint16_t RES_SOBRE_DIS; extern volatile uint16_t RES_SOBRE_TRA; // Ciclos sobre el umbral térmico
+extern volatile uint8_t RES_ENTRADAS[8];           // Entradas a cada bit de ESTADO
+extern volatile uint8_t RES_ESTADO_ANT;
+extern volatile uint16_t RES_CICLOS;
+extern volatile uint8_t RES_NUMERO;                 // Resúmenes armados
+extern volatile uint8_t RES_TRAMA[RESUMEN_BYTES];   // Último resumen armado
+extern volatile uint8_t RES_LISTO;                  // RES_TRAMA sin enviar
+extern volatile uint8_t CMD_BUF[CMD_COLA][3];       // Código, alto, bajo
+extern volatile uint8_t CMD_N;                      // Comandos en la cola
+extern volatile uint8_t CMD_RX[4];                  // Comando a medio recibir
+extern volatile uint8_t CMD_POS;                    // Bytes recibidos (0 = esperando CMD_SINCRO)
+extern volatile uint8_t CMD_APLICADOS; extern volatile uint8_t CMD_ERRORES;
+extern volatile uint8_t CMD_PEDIDOS;                // CMD_PRUEBA pendiente (bit = código)
+extern volatile uint8_t CMD_VOLCADO_POS;            // Próximo registro del volcado (EV_REGISTROS = ninguno)
+extern volatile uint8_t REF_REMOTA;                 // REF_ERR fijada por comando
+extern volatile uint8_t REF_CAIDA;                  // REF_ERR menos la caída por V_PICO
+extern volatile int16_t FASE_DIF;                   // AN0 en el índice simétrico menos en FASE_INDICE (10 bits)
+extern volatile uint16_t FASE_ATRASO;               // Atraso del seno en las dos muestras (1/256 de tick)
+extern volatile uint8_t CAIDA_PASO;                 // Atraso por tick en 1/65536 de tick (main)
+extern volatile uint16_t CAIDA_FASE;                // Atraso acumulado, fracción de tick (ISR)
+extern volatile uint8_t RETARDO_TICKS;              // Ticks enteros por agregar (ISR)
+extern volatile int16_t SINC_ERROR;                 // Esclavo: ticks adelantado respecto del maestro (ISR)
+extern volatile uint8_t SINC_ENGANCHE;              // Ciclos seguidos dentro de SINC_BANDA (satura en 255)
+
 // Medición y Protección
 extern volatile uint8_t CUENTA; extern volatile uint8_t C_MAXIMA;
 extern volatile uint8_t I_MINIMA;
 extern volatile uint8_t V_SALIDA; extern volatile uint8_t I_SALIDA;
 extern volatile uint8_t I_MAX; extern volatile uint8_t PP; extern volatile uint8_t PP_MAX;
+extern volatile uint16_t I_FILT;        // I_SALIDA filtrada, Q8
 
 // Temperaturas
 extern volatile uint8_t T_DISIP; extern volatile uint8_t T_DISIP1; extern volatile uint8_t T_DISIP2;
@@ -83,6 +256,13 @@ extern volatile uint8_t HIS_TRA1; extern volatile uint8_t HIS_TRA2;
 
 // Estados
 extern volatile uint8_t PREVIO; extern volatile uint8_t ESTADO;
+#define FALLA_ACTIVA (ESTADO & (1 << 6)) // Marcada por la ISR de INT0
+
+// Bajo consumo (tiempos en ticks de Timer0 = 51,2 us)
+extern volatile uint16_t T_WDT;         // Período del WDT calibrado contra el cristal
+extern volatile uint16_t TMR0_BASE;     // Última lectura de Timer0
+extern volatile uint32_t T_ACTIVO; extern volatile uint32_t T_DORMIDO;
+extern volatile uint8_t F_SUENO;        // Fracción de tiempo dormido (255 = 100 %)
 
 // Matemáticas (Argumentos)
 extern volatile uint8_t AARGB0; extern volatile uint8_t AARGB1; extern volatile uint8_t AARGB2; extern volatile uint8_t AARGB3; extern volatile uint8_t AARGB4;
@@ -90,6 +270,7 @@ extern volatile uint8_t BARGB0; extern volatile uint8_t BARGB1; extern volatile
 extern volatile uint8_t TEMPW; extern volatile uint8_t TEMPST; // Resguardo ISR
 
 // --- PROTOTIPOS DE FUNCIONES (Antes del Main) ---
+void inicializar_timer0(void);
 void inicializar_pines(void);
 void inicializar_puertos(void);
 void inicializar_adc(void);
@@ -98,7 +279,7 @@ void inicializar_spi(void);
 void inicializar_pwm_timer2(void);
 void inicializar_variables(void);
 
-void leer_AD(uint8_t canal);
+uint8_t leer_AD(uint8_t canal);
 void i_salida(void);
 void temperat(void);
 void encender(void);
@@ -108,6 +289,60 @@ void prueba(void);
 void out_fija(void);
 void apagar_1(void);
 void enviar(void);
+uint8_t autoajuste(void);
+void programar_ganancias(void);
+void compensar_tm(void);
+void observador_carga(void);
+void borrar_observador(void);
+void medir_vbat(void);
+void cargar_v_pico(void);
+void medir_thd(void);
+void borrar_thd(void);
+void pid_intermedio(void);
+
+// Registro de eventos en EEPROM (drivers.c)
+void inicializar_registro(void);
+void registrar_evento(uint8_t tipo);
+void registrar_falla(void);
+void eeprom_isr(void);
+uint8_t leer_eeprom(uint8_t dir);
+
+// Parámetros en EEPROM (drivers.c)
+void cargar_parametros(void);
+void guardar_parametros(void);
+
+// Bajo consumo (drivers.c)
+void calibrar_wdt(void);
+void dormir(void);
+void esperar_ciclo_idle(void);
+void contar_activo(void);
+void reporte_sueno(void);
+
+// Línea de tiempo del arranque (drivers.c)
+void marcar_arranque(uint8_t fase);
+
+// Comandos por SPI (control.c, drivers.c)
+void recibir_comando(uint8_t dato);
+void aplicar_comandos(void);
+uint8_t escribir_parametro(uint8_t indice, uint8_t valor);
+uint8_t leer_eeprom_en_marcha(uint8_t dir);
+uint8_t eeprom_ocupada(void);
+
+// Operación en paralelo (control.c)
+void caida_paralelo(void);
+
+// Sincronismo entre unidades (pwm.c)
+void borrar_sincronismo(void);
+
+// Resumen estadístico (control.c)
+void acumular_resumen(void);
+void contar_estados(void);
+void borrar_resumen(void);
+
+// Tiempos de las tareas (drivers.c)
+uint16_t leer_timer1(void);
+uint16_t medir_tarea(uint8_t tarea, uint16_t desde);
+void borrar_tarea(uint8_t tarea);
 
 // Subrutinas PID y Matemáticas (Necesarias globalmente por "Prototipos antes del Main")
 void PidInitialize(void);
@@ -116,6 +351,9 @@ void pid_2(void);
 void pid_3(void);
 void pid_4(void);
 void calculos_sinusoide(void);
+void repetitivo(void);
+void borrar_repetitivo(void);
+extern const uint16_t SINE_TABLE[PUNTOS_SENO];
 void ccpr1(void);
 
 // Funciones Matemáticas Auxiliares (Implementadas en control.c)
@@ -123,6 +361,7 @@ void FXM1616U(void);
 void FXM2416U(void);
 void FXD2416U(void);
 void _24_BitAdd(void);
+void _24_bit_sub(void);
 void MagAndSub(void);
 void SpecSign(void);
 
@@ -0,0 +1,483 @@
+/**
+ * @file opciones.h
+ * @brief Opciones de compilación y parámetros fijos del firmware.
+ * Todo lo que se elige al compilar (modos, tiempos, umbrales fijos) se define aquí.
+ */
+
+#ifndef OPCIONES_H
+#define OPCIONES_H
+
+// --- BAJO CONSUMO ---
+// El WDT queda apagado por configuración (WDT = OFF) y se habilita por software
+// (SWDTEN) solo mientras el micro duerme entre pruebas de carga.
+// Con WDTPS = 16 el período nominal es 16 x 4,096 ms = 65,5 ms (INTRC 31 kHz).
+#define WDT_PERIODO_NOM     1280    // Período nominal del WDT en ticks de Timer0 (51,2 us)
+#define UMBRAL_RC_PRUEBA    140     // Umbral del RC (AN9) que marca el fin de la espera
+
+// --- MODULACIÓN ---
+// MOD_SEMICICLO: conmuta una sola rama por semiciclo (K par CCP1, K impar CCP2) y
+// la otra queda en 0.
+// MOD_UNIPOLAR: las dos ramas conmutan en cada tick con referencias
+// complementarias d1 = (1 + m sen) / 2, d2 = (1 - m sen) / 2 (SPWM unipolar).
+// Los CCP del 18F2520 comparten Timer2 y ambos pulsos arrancan en el mismo flanco,
+// así que d1 - d2 sale como un solo pulso por período, entre d2 y d1: mismo
+// rizado a 19,53 kHz que MOD_SEMICICLO, pulso centrado y las dos ramas
+// repartiendo la conmutación. El rizado a 39 kHz pide portadoras desfasadas 180°.
+#define MOD_SEMICICLO       0
+#define MOD_UNIPOLAR        1
+#ifndef MODULACION
+#define MODULACION          MOD_SEMICICLO
+#endif
+#ifndef MEDIR_ISR
+#define MEDIR_ISR           0       // 1 = peor TMR2 al salir de la ISR en ISR_TCY, y en la trama
+#endif
+
+// --- DITHER DEL DUTY ---
+// ccpr1() trunca V_PICO x SENO >> 14 a 10 bits. Con DITHER_BITS > 0 los bits que
+// siguen al LSB se acumulan tick a tick (sigma-delta de primer orden) y cada
+// desborde suma una cuenta: el duty medio gana DITHER_BITS bits de resolución y el
+// error de cuantización se corre a la frecuencia de la portadora, que filtra el LC.
+#ifndef DITHER_BITS
+#define DITHER_BITS         2       // 0 = truncar, 2..4 = bits extra
+#endif
+
+// --- ADC SINCRONIZADO CON LA FASE ---
+// La ISR de Timer2 convierte AN0 y AN1 al empezar índices fijos de SINE_TABLE, así
+// cada lectura cae siempre en la misma fase de la senoidal y no donde el bucle
+// principal llegue a leer_AD(). La tensión se toma en el pico del segundo
+// semiciclo (la más nueva antes del pid() del ciclo siguiente) y la corriente en
+// dos puntos de cada semiciclo, de los que i_salida() usa el mayor. La ISR arranca
+// la conversión (adquisición automática, ACQT) y la lee en el tick siguiente: no
+// espera al A/D. Si el bucle principal está en leer_AD() la muestra se pierde y
+// main() hace su propia lectura; leer_AD() espera, si hace falta, a que la ISR
+// recoja la suya (hasta un tick).
+// Con REPETITIVO la tensión sigue saliendo de repetitivo(): solo se sincroniza AN1.
+#ifndef AD_SINCRONO
+#define AD_SINCRONO         0       // 1 = lecturas de AN0/AN1 desde la ISR
+#endif
+#define AD_INDICE_V         48      // AN0 en el pico del semiciclo K = 1
+#define AD_INDICE_I1        40      // AN1 en los dos semiciclos
+#define AD_INDICE_I2        56
+
+// --- ESTIMADOR DE THD (GOERTZEL) ---
+// En la espera del fin de ciclo se lee AN0 en 14 índices fijos del semiciclo K = 1
+// (cada 7 puntos de la tabla, corridos THD_FASE del cruce por cero, donde el
+// divisor rectificado dobla la forma de onda) y cada muestra avanza un resonador de Goertzel por
+// armónico impar: 1, 3, ..., THD_ARMONICO_MAX. Con simetría de media onda el
+// semiciclo siguiente es el mismo con el signo cambiado, así que las muestras
+// entran con signo alternado ciclo a ciclo y forman una senoidal de 28 muestras
+// por período. Cada THD_CICLOS ciclos se cierra el bloque y THD_X10 (0,1 %) se
+// publica en la telemetría (trama cruda en cada ciclo, o el resumen con RESUMEN).
+// No usa la ISR: una muestra perdida descarta el bloque.
+// Necesita AN0 instantánea (divisor rectificado, como REPETITIVO): con el
+// detector de pico la forma de onda no llega al conversor.
+#ifndef THD_GOERTZEL
+#define THD_GOERTZEL        0       // 1 = estimar la THD
+#endif
+#define THD_ARMONICO_MAX    13      // Impar, hasta 13 (28 muestras por período)
+#define THD_CICLOS          8       // Ciclos por bloque (hasta 8: estado en 32 bits)
+#define THD_PASO            7       // Índices de la tabla entre muestras
+#define THD_FASE            3       // Primera muestra (0..6)
+#if THD_ARMONICO_MAX > 13 || THD_ARMONICO_MAX % 2 == 0 || THD_CICLOS > 8 || THD_FASE > 6
+#error "THD_ARMONICO_MAX impar <= 13, THD_CICLOS <= 8 y THD_FASE <= 6"
+#endif
+
+// --- REGISTRO DE EVENTOS (EEPROM) ---
+// Cada disparo deja un registro de EV_BYTES en la EEPROM de datos, en un anillo de
+// EV_REGISTROS que se recorre entero antes de volver a escribir una posición
+// (desgaste parejo). El registro más nuevo es el último de la cadena de números de
+// secuencia consecutivos. La secuencia se borra (EV_SEQ_VACIA) antes de los datos
+// y se escribe al final, así un registro a medio escribir por un corte queda como
+// posición vacía y se pisa primero, aunque el anillo ya haya dado la vuelta.
+// registrar_evento() solo encola: la ISR escribe un byte por interrupción EEIF
+// (unos 4 ms cada uno, EV_BYTES + 1 por registro) y el bucle de 50 Hz no espera a
+// la EEPROM.
+// Lectura en el host: volcado de la EEPROM con el programador (.hex o binario)
+// y sim/registro.c (./inversor_registro).
+#ifndef REGISTRO_EVENTOS
+#define REGISTRO_EVENTOS    1       // 0 = sin registro
+#endif
+#define EV_BASE             0x00    // Dirección del primer registro
+#define EV_REGISTROS        16      // Registros en el anillo (160 bytes)
+#define EV_BYTES            10
+#define EV_COLA             2       // Registros en espera de escritura
+// Registro: secuencia, tipo, ciclos de 50 Hz desde el arranque (4 bytes, MSB
+// primero), I_SALIDA, T_DISIP, T_TRAFO, V_SALIDA
+#define EV_SEQ              0
+#define EV_TIPO             1
+#define EV_CICLOS           2
+#define EV_I_SALIDA         6
+#define EV_T_DISIP          7
+#define EV_T_TRAFO          8
+#define EV_V_SALIDA         9
+#define EV_SEQ_VACIA        0xFF    // EEPROM borrada: la secuencia salta de 0xFE a 0
+// Tipo: causas del disparo (puede haber varias) o arranque
+#define EV_SOBRECORRIENTE   (1 << 0)    // PREVIO<1>
+#define EV_DISIPADOR        (1 << 1)    // PREVIO<3>
+#define EV_TRAFO            (1 << 2)    // PREVIO<5>
+#define EV_BATERIA          (1 << 3)    // ESTADO<5>
+#define EV_FALLA_HW         (1 << 4)    // ESTADO<6> o RB0 en 0
+#define EV_ARRANQUE         (1 << 7)    // Reset del micro
+
+// --- PARÁMETROS EN EEPROM ---
+// Los ajustes de campo (ganancias, referencia, límites, umbrales térmicos) viven en
+// un bloque de la EEPROM de datos con versión y CRC-16 (CCITT, inicial 0xFFFF).
+// inicializar_variables() carga primero los valores compilados y cargar_parametros()
+// los reemplaza si el bloque es válido; si no (EEPROM borrada, otra versión, CRC
+// malo) quedan los compilados. guardar_parametros() toma los valores de RAM y los
+// escribe por la misma vía de interrupción EEIF que el registro de eventos, sin
+// reescribir los bytes que no cambian. Un corte a mitad de escritura deja el CRC
+// malo: el próximo arranque usa los compilados.
+#ifndef PARAMETROS_EEPROM
+#define PARAMETROS_EEPROM   1       // 0 = solo los valores compilados
+#endif
+#define PAR_BASE            0xA0    // Detrás del anillo de eventos
+#define PAR_VERSION         1       // Cambiar si cambia el orden o la cantidad de PAR_VARIABLES[]
+// Orden de las variables (PAR_VARIABLES[] en drivers.c, nombres en sim/registro.c):
+// kp ki kd (nominales) REF0 REF1 V_MAX_0 V_MAX_1 I_MAX PP_MAX T_DISIP1 T_DISIP2
+// HIS_DIS1 HIS_DIS2 T_TRAFO1 T_TRAFO2 HIS_TRA1 HIS_TRA2 AA C_MAXIMA AJUSTADO
+#define PAR_CANTIDAD        20
+#define PAR_BYTES           (PAR_CANTIDAD + 3)  // Versión, variables, CRC (MSB primero)
+#if PAR_BASE < EV_BASE + EV_REGISTROS * EV_BYTES || PAR_BASE + PAR_BYTES > 0x100
+#error "El bloque de parámetros no entra detrás del registro de eventos"
+#endif
+
+// --- LÍNEA DE TIEMPO DEL ARRANQUE Y ARRANQUE RÁPIDO ---
+// Timer0 (libre, 51,2 us por cuenta) arranca antes que cualquier otra inicialización
+// y marcar_arranque() guarda su valor al terminar cada fase del primer arranque; la
+// primera trama de enviar() agrega ARR_MARCAS y las ARR_FASES marcas (2 bytes, MSB
+// primero). Sin ninguna telemetría, main() manda igual esa primera trama. El PWRT
+// (~66 ms) y el arranque del cristal (1024 Tosc) pasan antes de la primera
+// instrucción: no aparecen en las marcas.
+#define ARR_PERIFERICOS     0       // Fin de inicializar_pines() .. inicializar_pwm_timer2()
+#define ARR_VARIABLES       1       // Fin de inicializar_variables() (parámetros) y del registro
+#define ARR_FF              2       // FF de protección reseteado (RB0 en 1)
+#define ARR_REF             3       // REF_ERR leída: arranca la rampa
+#define ARR_PRUEBA          4       // Prueba de carga al final del primer ciclo de la rampa
+#define ARR_POTENCIA        5       // V_PICO llegó a V_MAX
+#define ARR_FASES           6
+// Arranque rápido: el reset del FF se pide apenas están configurados los puertos y
+// la espera corre en paralelo con el resto de las inicializaciones. La rampa empieza
+// en INICIO como siempre, pero si la corriente del primer ciclo, llevada a
+// ARR_INICIO_RAPIDO, queda por debajo de I_MAX >> ARR_MARGEN (carga resistiva o
+// vacío), V_PICO salta a ARR_INICIO_RAPIDO. Motores y rectificadores con el
+// capacitor descargado piden más corriente en el primer ciclo y siguen la rampa.
+#ifndef ARRANQUE_RAPIDO
+#define ARRANQUE_RAPIDO     0       // 1 = reset del FF en paralelo y salto de la rampa
+#endif
+#define ARR_INICIO_RAPIDO   400     // V_PICO tras una prueba favorable (V_MAX = 675)
+#define ARR_MARGEN          1       // Corriente prevista <= I_MAX / 2
+
+// --- PUNTOS DE TRAZA ---
+// TRAZA(id) marca la entrada y salida de las rutinas del lazo (pid(), i_salida(),
+// temperat(), enviar()), el inicio del ciclo de 50 Hz y los cambios de estado
+// (encender, apagar, apagar_1, prueba, out_fija); los números están en
+// global_vars.h. Con TRAZA_MODO = 0 no generan código.
+// TRAZA_PINES: cada punto es una ráfaga de id pulsos de 1 Tcy en RB6 (LECTURA),
+// unos 4 Tcy por pulso, con TMR2IE en 0 para que los puntos de la ISR no se
+// mezclen en la ráfaga. GIE queda en 1: el corte por INT0 no espera a la ráfaga
+// (16 pulsos son ~13 us). RB6 deja de marcar las conversiones y el tiempo
+// ocupado del ciclo.
+// TRAZA_SPI: cada punto deja 3 bytes en un anillo en RAM (id con NN - 1 en el bit
+// 7, índice de la tabla con K impar sumando PUNTOS_SENO, TMR2) que enviar() agrega
+// a la trama y vacía (main() la manda en cada ciclo; con RESUMEN, cada resumen);
+// si se llena se pisan los más viejos. Con el puente apagado
+// Timer2 está detenido y las marcas de tiempo no avanzan.
+// La ISR de Timer2 tiene sus puntos aparte (TRAZA_CON_ISR): dos cada 51,2 us
+// llenan el anillo enseguida. El de entrada se toma antes de avanzar NN y
+// CICLO_0, así que su marca queda un tick atrás.
+#define TRAZA_PINES         1
+#define TRAZA_SPI           2
+#ifndef TRAZA_MODO
+#define TRAZA_MODO          0       // 0 = sin traza, TRAZA_PINES o TRAZA_SPI
+#endif
+#ifndef TRAZA_CON_ISR
+#define TRAZA_CON_ISR       0       // 1 = también entrada y salida de la ISR de Timer2
+#endif
+#define TRAZA_REGISTROS     32      // Registros del anillo (TRAZA_SPI, 96 bytes)
+#if TRAZA_REGISTROS & (TRAZA_REGISTROS - 1)
+#error "TRAZA_REGISTROS tiene que ser potencia de 2"
+#endif
+
+// --- TIEMPOS DE LAS TAREAS ---
+// Timer1 libre (Fosc/4, 1:8 -> 1,6 us por cuenta) mide cada tarea del ciclo de
+// 50 Hz y la holgura: desde que termina el trabajo del ciclo hasta que K llega a 2
+// (lo que corre en la espera, como repetitivo() o medir_thd(), queda adentro).
+// Por tarea se guardan mínimo, máximo y un histograma de cubetas logarítmicas:
+// la cubeta b > 0 cuenta tiempos de 2^(b-1) a 2^b - 1 en unidades de
+// 2^HIST_DESPL cuentas (6,4 us) y la última junta todo lo que pasa de 6,6 ms.
+// enviar() manda una tarea por trama, por turno, y la borra: con una trama por
+// ciclo cada tarea sale cada TAREAS ciclos (con RESUMEN, una por resumen).
+// HOLGURA_CERO cuenta los ciclos en que K ya valía 2 o más al terminar el trabajo
+// (ciclo desbordado): es la misma condición que termina la espera (K < 2), que en
+// ese caso no espera.
+#ifndef MEDIR_TAREAS
+#define MEDIR_TAREAS        0       // 1 = tiempos e histogramas en la telemetría
+#endif
+#define TAREA_V_PICO        0       // cargar_v_pico()
+#define TAREA_AD_V          1       // Lectura de V_SALIDA
+#define TAREA_PID           2
+#define TAREA_I_SALIDA      3
+#define TAREA_AJUSTES       4       // programar_ganancias(), compensar_tm(), observador_carga()
+#define TAREA_TEMPERAT      5
+#define TAREA_BATERIA       6
+#define TAREA_AHORRO        7       // Llave y umbral de Bajo Consumo
+#define TAREA_OCUPADO       8       // Todo el trabajo del ciclo (K = 0 hasta la espera)
+#define TAREA_HOLGURA       9       // Espera hasta K = 2
+#define TAREAS              10
+#define HIST_CUBETAS        12
+#define HIST_DESPL          2
+
+// --- TELEMETRÍA POR SPI ---
+// enviar() manda la trama cruda al display: V_SALIDA, I_SALIDA, T_DISIP, T_TRAFO,
+// ESTADO, F_SUENO y THD_X10 (7 bytes, ~0,2 ms a Fosc/64). Con TELEMETRIA, main()
+// la llama una vez por ciclo de 50 Hz, al terminar el trabajo y antes de la espera.
+#ifndef TELEMETRIA
+#define TELEMETRIA          0       // 1 = trama cruda por SPI en cada ciclo
+#endif
+
+// --- RESUMEN ESTADÍSTICO ---
+// En vez de las muestras crudas de cada trama, main() acumula por ciclo de 50 Hz
+// V_SALIDA, I_SALIDA, T_DISIP y T_TRAFO (mínimo, máximo y suma), un histograma de
+// I_SALIDA de RES_CUBETAS cubetas fijas, los ciclos sobre el umbral térmico de
+// disipador y de trafo (PREVIO<2,3> y PREVIO<4,5>: ventilador o puente apagado,
+// con la histéresis de temperat()) y las entradas a cada bit de ESTADO. Cada 2^RESUMEN_LOG2
+// ciclos (512 -> 10,24 s) arma RES_TRAMA y main() llama a enviar(), que la manda
+// en lugar de los 7 bytes crudos: RESUMEN_BYTES bytes cada 10 s contra 7 por ciclo.
+// Trama: número de resumen; mínimo, máximo y media de las 4 variables; cubetas
+// (16 bits, MSB primero); ciclos sobre el umbral de disipador y trafo (16 bits);
+// entradas a ESTADO<0..7> (saturadas en 255); F_SUENO y THD_X10. Solo cuentan
+// los ciclos del lazo: el tiempo dentro de apagar() no avanza el intervalo.
+#ifndef RESUMEN
+#define RESUMEN             0       // 1 = resumen cada 2^RESUMEN_LOG2 ciclos
+#endif
+#ifndef RESUMEN_LOG2
+#define RESUMEN_LOG2        9
+#endif
+#define RES_VARIABLES       4       // V_SALIDA, I_SALIDA, T_DISIP, T_TRAFO
+#define RES_CUBETAS         8       // I_SALIDA >> RES_CUBETA_DESPL
+#define RES_CUBETA_DESPL    5       // Cubetas de 32 cuentas (I_MAX = 242)
+#define RESUMEN_BYTES       (1 + 3 * RES_VARIABLES + 2 * RES_CUBETAS + 4 + 8 + 2)
+#if RESUMEN_LOG2 > 15
+#error "RESUMEN_LOG2: la cuenta de ciclos es de 16 bits"
+#endif
+
+// --- COMANDOS POR SPI ---
+// El PIC es el maestro: en cada byte de enviar() el display devuelve uno por SDI
+// (RC4, entrada solo durante la trama). Sin comandos manda 0x00. Un comando son 5
+// bytes: CMD_SINCRO, código, dato alto, dato bajo y ~(código + alto + bajo). Los
+// válidos esperan en una cola y main() los aplica todos juntos al empezar el ciclo
+// de 50 Hz siguiente; los malos o sin lugar cuentan en CMD_ERRORES. enviar() agrega
+// al final de la trama CMD_APLICADOS, CMD_ERRORES (ambos rotan en 8 bits) y la
+// cantidad de registros del volcado que siguen (0 si no se pidió). El volcado sale
+// de a CMD_VOLCADO_TRAMA registros por trama, precedidos por la posición en el
+// anillo del primero; con una escritura de EEPROM en curso se saltea la trama
+// para no esperarla.
+// Sin RESUMEN, main() llama a enviar() en cada ciclo (trama cruda); con RESUMEN
+// los comandos esperan la trama del resumen.
+#ifndef COMANDOS_SPI
+#define COMANDOS_SPI        0       // 1 = recibe comandos del display por SPI
+#endif
+#define CMD_SINCRO          0xA5
+#define CMD_COLA            4       // Comandos esperando el fin del ciclo
+#define CMD_REFERENCIA      0x01    // REF_ERR = bajo; 0 vuelve a AN3 en el próximo arranque
+#define CMD_PARAMETRO       0x02    // Variable alto de PAR_VARIABLES[] (ver arriba) = bajo
+#define CMD_GUARDAR         0x03    // guardar_parametros()
+#define CMD_VOLCADO         0x04    // Las próximas tramas agregan el anillo de eventos
+#define CMD_PRUEBA          0x05    // Prueba de carga en este ciclo (como Bajo Consumo)
+#define CMD_VOLCADO_TRAMA   4       // Registros del volcado por trama (40 bytes, ~1 ms)
+#if EV_REGISTROS % CMD_VOLCADO_TRAMA != 0
+#error "CMD_VOLCADO_TRAMA tiene que dividir a EV_REGISTROS"
+#endif
+
+// --- PID MULTITASA ---
+// Actualizaciones del PID por ciclo de 50 Hz: 1 (al inicio del ciclo), 2 (también
+// al cambiar K, en el cruce del semiciclo) o más, cada PID_TICKS ticks de Timer2.
+// Tiene que dividir a los 392 ticks del ciclo y derivCountRecarga caber en 8 bits:
+// 1, 2, 4, 7, 8 o 14. La integral suma error / PID_POR_CICLO y el derivativo se
+// calcula cada derivCountVal x PID_POR_CICLO actualizaciones: mismas constantes de
+// tiempo que con una por ciclo, sin tocar kp/ki/kd.
+#ifndef PID_POR_CICLO
+#define PID_POR_CICLO       1
+#endif
+#define TICKS_CICLO         392     // 98 puntos x 2 ticks x 2 semiciclos
+#define PID_TICKS           (TICKS_CICLO / PID_POR_CICLO)
+#if TICKS_CICLO % PID_POR_CICLO != 0 || PID_POR_CICLO > 25
+#error "PID_POR_CICLO tiene que dividir a 392 y ser <= 25"
+#endif
+
+// --- AUTOAJUSTE DEL PID (relé de Åström-Hägglund) ---
+// En la primera puesta en marcha la amplitud conmuta entre REF +/- AUTO_D según el
+// signo del error de V_SALIDA respecto de REF_ERR. De la oscilación resultante
+// (amplitud a, período Tu en ciclos de 50 Hz) sale Ku = 4d / (pi a) y, con las
+// reglas de Ziegler-Nichols, kp/ki/kd en la escala U_0:U_1 / U del PID.
+#ifndef AUTOAJUSTE_PID
+#define AUTOAJUSTE_PID      0       // 1 = medir las ganancias al arrancar
+#endif
+#define AUTO_D              40      // Amplitud del relé en cuentas de V_PICO (~6 %)
+#define AUTO_HIST           2       // Histéresis del relé en cuentas de V_SALIDA
+#define AUTO_DESCARTE       2       // Períodos descartados hasta que la oscilación se asienta
+#define AUTO_PERIODOS       4       // Períodos promediados
+#define AUTO_SIN_CRUCE      10      // Ciclos sin cruce antes de correr el centro del relé
+#define AUTO_CICLOS_MAX     400     // Límite de la prueba (8 s)
+#define AUTO_CON_D          0       // 0 = PI (kd = 0), 1 = PID
+
+// --- VARIANTE DEL PID ---
+// Términos que se compilan en pid(). Con PID_VAR_PI no quedan Derivative(),
+// DeltaError() ni la suma con signo del derivativo en GetPidResult(); con PID_VAR_P
+// tampoco la integral: la salida es kp x error con el signo del error.
+// kp/ki/kd siguen existiendo (autoajuste, programación, simulador), pero las
+// ganancias de los términos que no se compilan no tienen efecto.
+#define PID_VAR_P           1
+#define PID_VAR_PI          2
+#define PID_VAR_PID         3
+#ifndef PID_VARIANTE
+#define PID_VARIANTE        PID_VAR_PI      // kd = 0 en producción
+#endif
+#if AUTOAJUSTE_PID && AUTO_CON_D && PID_VARIANTE != PID_VAR_PID
+#error "AUTO_CON_D necesita PID_VARIANTE = PID_VAR_PID"
+#endif
+
+// --- PROGRAMACIÓN DE GANANCIAS POR CARGA ---
+// Una vez por ciclo kp/ki/kd salen de kp_nom/ki_nom/kd_nom escalados por una
+// tabla (control.c) indexada por I_SALIDA filtrada, interpolada en punto fijo.
+#ifndef PROGRAMA_GANANCIAS
+#define PROGRAMA_GANANCIAS  1       // 0 = ganancias fijas
+#endif
+#define FILTRO_I_SALIDA     3       // I_FILT += (I_SALIDA - I_FILT) / 2^3 por ciclo
+
+// --- CONTROL REPETITIVO ---
+// Corrección de la forma de onda por muestra: una entrada de CORRECCION por índice
+// de SINE_TABLE, aprendida ciclo a ciclo del error instantáneo de AN0 y sumada al
+// duty en ccpr1(). Requiere AN0 sin retención de pico (divisor rectificado
+// directo): V_SALIDA pasa a ser la muestra tomada en REP_INDICE_PICO.
+#ifndef REPETITIVO
+#define REPETITIVO          0       // 1 = corrección por muestra
+#endif
+#define REP_KR_Q4           2       // Cuentas de duty (Q4) por cuenta de error: Kr = 0,125
+#define REP_ADELANTO        4       // Índices de adelanto de fase (PWM + ADC + filtro LC)
+#define REP_VENTANA         8       // Promedio del error (8 x 102 us: nulo en 1,2 kHz)
+#define REP_OLVIDO          6       // C -= C / 2^6 por ciclo: olvida lo que ya no hace falta
+#define REP_LIMITE          (48 << 4) // Corrección máxima: 48 cuentas de duty (Q4)
+#define REP_INDICE_PICO     48      // Muestra usada como V_SALIDA por el PID
+
+// --- COMPENSACIÓN DE TIEMPO MUERTO ---
+// Durante el tiempo muerto del IR2110 y del FF la tensión de la rama la fija el
+// diodo que conduce: cada rama que conmuta pierde tm / T de duty en el sentido de
+// la corriente. ccpr1() suma COMP_TM[] (pwm.c) según la fase de la corriente del
+// puente, que adelanta a la tensión por la corriente del capacitor del filtro;
+// compensar_tm() fija ese adelanto y la pendiente una vez por ciclo desde I_SALIDA.
+// El signo sale de ese modelo y no de la corriente medida: AN1 (e I_SINC) viene
+// de un detector rectificado y no tiene polaridad. Vale solo con carga
+// resistiva: con RL (atraso) o rectificadores (pulsos) la fase estimada no es
+// la real y la THD empeora (simulador, tm=2: R 2,64 -> 1,63 %, RL 2,87 -> 3,43 %).
+// Para banco y simulador; no habilitar en equipos de campo, donde la carga no
+// se conoce.
+#ifndef COMPENSA_TM
+#define COMPENSA_TM         0       // 1 = compensar (solo carga resistiva)
+#endif
+#define TM_CUENTAS          40      // Tiempo muerto por rama en cuentas de duty (2 us / 51,2 us x 1024)
+
+// --- OBSERVADOR DE CARGA ---
+// La caída de salida con carga es casi proporcional a la corriente (puente, trafo
+// y filtro), así que I_SALIDA sobre su lectura en vacío predice cuánto V_PICO
+// hace falta. observador_carga() la pone en OBS_V, que se suma a la salida del PID
+// en cada ciclo, y ante un escalón la aplica en el mismo ciclo en que lo detecta,
+// sin esperar al próximo pid().
+#ifndef OBSERVADOR_CARGA
+#define OBSERVADOR_CARGA    1       // 0 = solo el PID
+#endif
+#define OBS_ESCALON         8       // Cambio de I_SALIDA que se aplica en el acto
+#define OBS_MAXIMO          80      // Predicción máxima en cuentas de V_PICO
+#define OBS_RAMPA           2       // Paso de OBS_V por ciclo al volver a encender o salir de PP
+#define OBS_I_VACIO         0       // I_SALIDA sin carga: AN1 mide la corriente hacia la carga
+
+// --- OPERACIÓN EN PARALELO (CAÍDA) ---
+// Varios inversores con las salidas (capacitores del filtro) en el mismo bus, sin
+// enlace entre ellos: cada uno se reparte la carga por caída (caida_paralelo()).
+// - Frecuencia: la potencia activa sale del ángulo entre el puente y el bus. En
+//   K = 1 la ISR lee AN0 en FASE_INDICE y en PUNTOS_SENO - FASE_INDICE, simétricos
+//   respecto del pico: la diferencia es 2 V cos(fase) sen(ángulo), con signo, y el
+//   error de ganancia de AN0 no la corre de cero. Cada tick el seno se atrasa
+//   ángulo x CAIDA_F / 2^20 de tick (~0,15 % a plena carga con 45): el que entrega
+//   más se atrasa hasta que todos tienen el mismo ángulo. Solo baja: la que
+//   absorbe queda a la frecuencia nominal y las demás se le acercan.
+// - Tensión: la referencia del PID baja (V_PICO - CAIDA_BASE) x CAIDA_V / 256.
+//   V_PICO sube en la unidad que empuja la corriente reactiva que circula entre
+//   ellas (I_SALIDA es un detector de pico sin signo y no distingue quién la
+//   empuja). CAIDA_BASE es V_PICO en vacío con la batería nominal (689); a plena
+//   carga el bus queda ~2 % abajo.
+// Necesita AN0 instantánea (divisor rectificado, como REPETITIVO) y AD_SINCRONO:
+// V_SALIDA es la muestra de AD_INDICE_V y las de fase caen en la ISR.
+#ifndef PARALELO
+#define PARALELO            0       // 1 = caída de tensión y frecuencia
+#endif
+#define CAIDA_V             96
+#define CAIDA_F             45
+#define CAIDA_BASE          689
+#define FASE_INDICE         8       // 14,7° del cruce por cero
+#if PARALELO && !AD_SINCRONO
+#error "PARALELO necesita AD_SINCRONO"
+#endif
+
+// --- SINCRONISMO ENTRE UNIDADES ---
+// SYNC_OSC (RB7) deja de ser la marca del osciloscopio y une a los inversores.
+// El maestro la pone en 1 desde la ISR durante los dos primeros puntos de cada
+// ciclo (sin la demora del bucle principal). En el esclavo es entrada:
+// - encender() espera el flanco de subida y SINC_DESFASE ticks más antes de largar
+//   Timer2. Si en SINC_ESPERA ticks no hay flanco arranca libre.
+// - En cada flanco la ISR mide cuántos ticks va adelantada o atrasada su tabla.
+//   Pasado ±SINC_BANDA corrige todo el error: uno de cada cuatro puntos dura 3
+//   ticks (atrasa) o 1 (adelanta), hasta 49 ticks por ciclo (~12 %).
+// - enviar() va en cada ciclo y agrega SINC_ERROR (2 bytes) y SINC_ENGANCHE.
+// Fase partida: SINC_DESFASE = TICKS_CICLO / 2 (180°).
+#define SINC_LIBRE          0
+#define SINC_MAESTRO        1
+#define SINC_ESCLAVO        2
+#ifndef SINCRONISMO
+#define SINCRONISMO         SINC_LIBRE
+#endif
+#ifndef SINC_DESFASE
+#define SINC_DESFASE        0       // Ticks de atraso respecto del maestro
+#endif
+#define SINC_BANDA          2       // Error en ticks que no se corrige
+#define SINC_ESPERA         10000   // Ticks de Timer0 esperando al maestro (0,5 s)
+#if SINC_DESFASE >= TICKS_CICLO
+#error "SINC_DESFASE: 0 a TICKS_CICLO - 1"
+#endif
+
+// --- PREALIMENTACIÓN DE BATERÍA ---
+// Una vez por ciclo se mide la batería (divisor con 32 V = 255) y V_PICO sale de
+// TEMPO:TEMP1 por VBAT_NOM / V_BAT, con el recíproco en tabla (control.c): el duty
+// sigue a la batería y el PID solo corrige lo que queda.
+// Esta placa no tiene entrada analógica libre: AN0-AN4, AN8 y AN9 están en uso y
+// AN10, AN11 y AN12 son RB1 (reset del FF), RB4 (AIRE) y RB0 (FALLA_HW). Tampoco
+// queda un pin al que mudar el reset del FF o AIRE, y el A/D leería la propia
+// salida: hasta la revisión de placa que agregue el divisor la opción solo compila
+// en el simulador, que modela CANAL_VBAT (10 u 11) como una entrada aparte. PCFG
+// deja analógicos AN0 hasta CANAL_VBAT, así que AN12 apagaría la entrada digital
+// de FALLA_HW (se lee 0: falla permanente) y AN5-AN7 no existen en el 28 pines.
+#ifndef PREALIM_VBAT
+#define PREALIM_VBAT        0       // 1 = escalar V_PICO por la batería (solo simulador)
+#endif
+#if PREALIM_VBAT && !defined(SIMULADOR)
+#error "PREALIM_VBAT: AN10 y AN11 son RB1 (reset del FF) y RB4 (AIRE), salidas en esta placa"
+#endif
+#if PREALIM_VBAT && !defined(CANAL_VBAT)
+#error "PREALIM_VBAT necesita CANAL_VBAT: la placa actual no tiene entrada analógica libre"
+#endif
+#if PREALIM_VBAT && (CANAL_VBAT < 10 || CANAL_VBAT > 11)
+#error "CANAL_VBAT tiene que ser 10 u 11: AN0-AN9 están en uso o no existen y AN12 es FALLA_HW (RB0)"
+#endif
+#define VBAT_NOM_CUENTAS    192     // 24 V nominales en el divisor de 32 V
+#define VBAT_INDICE         73      // Lectura a 135° del segundo semiciclo
+
+// Pendiente del observador de carga: de vacío a plena carga (I_SALIDA 161) V_PICO
+// sube 72 cuentas; con la prealimentación la caída de la batería (~24) ya está cubierta
+#if PREALIM_VBAT
+#define OBS_K_Q8            77      // Cuentas de V_PICO por cuenta de I_SALIDA (Q8): 48 / 161
+#else
+#define OBS_K_Q8            115     // 72 / 161
+#endif
+
+#endif // OPCIONES_H
@@ -0,0 +1,485 @@
+/**
+ * @file barrido.c
+ * @brief Barrido paralelo de ganancias y umbrales sobre una biblioteca de escenarios.
+ *
+ * Cada combinación de parámetros se corre en todos los escenarios; los trabajos
+ * (combinación x escenario) se reparten en un pool de hilos con robo de trabajo.
+ * El firmware vive en variables globales de main.c, así que cada hilo carga su
+ * propia copia de _sim/libinversor.so (biblioteca.c), y el dlclose() al terminar
+ * cada trabajo deja la RAM en cero para la siguiente corrida, como el arranque del PIC.
+ *
+ * Compilación: sim/compilar.sh  (genera ./inversor_barrido)
+ * Uso: ./inversor_barrido [clave=lista ...] [hilos=N] [escenarios=archivo] [top=20]
+ *                         [csv=archivo] [escalado=1] [biblioteca=_sim/libinversor.so]
+ *   lista: un valor, v1,v2,v3 o ini:fin:paso. Claves: las de simulador.c.
+ *   Ejemplo: ./inversor_barrido kp=30:90:10 ki=20:80:10 kd=0,4 t=1.5
+ *
+ * Ranking por combinación (peor caso entre escenarios): disparos, escenarios sin
+ * establecer, tiempo de establecimiento, sobrepico y THD, en ese orden.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "simulador.h"
+#include "biblioteca.h"
+
+#define MAX_PARAMS      16
+#define MAX_VALORES     64
+#define MAX_ESCENARIOS  64
+#define MAX_HILOS       256
+#define LARGO_TEXTO     256
+
+// Parámetro barrido: clave y lista de valores en texto
+typedef struct {
+    char clave[32];
+    char valores[MAX_VALORES][24];
+    int n;
+} param_t;
+
+typedef struct {
+    char nombre[32];
+    char texto[LARGO_TEXTO];    // clave=valor separados por espacios
+} escenario_t;
+
+// Cola de un hilo: el dueño toma del final, los ladrones del principio
+typedef struct {
+    pthread_mutex_t m;
+    uint32_t *trabajos;
+    uint32_t ini, fin;
+    uint32_t hechos, robados;
+    char biblioteca[512];
+} cola_t;
+
+static param_t params[MAX_PARAMS];
+static int n_params;
+static escenario_t escenarios[MAX_ESCENARIOS];
+static int n_escenarios;
+static uint32_t n_combinaciones;
+static sim_metricas_t *resultados;
+static cola_t colas[MAX_HILOS];
+static int n_hilos;
+
+// --- PARÁMETROS ---
+
+static int expandir(param_t *p, const char *lista) {
+    double ini, fin, paso, v;
+    char copia[LARGO_TEXTO], *tok, *resto;
+
+    p->n = 0;
+    if (sscanf(lista, "%lf:%lf:%lf", &ini, &fin, &paso) == 3 && paso > 0.0)
+    {
+        for (v = ini; v <= fin + paso * 1e-9 && p->n < MAX_VALORES; v += paso)
+            snprintf(p->valores[p->n++], sizeof(p->valores[0]), "%g", v);
+        return p->n;
+    }
+    snprintf(copia, sizeof(copia), "%s", lista);
+    for (tok = strtok_r(copia, ",", &resto); tok && p->n < MAX_VALORES; tok = strtok_r(NULL, ",", &resto))
+        snprintf(p->valores[p->n++], sizeof(p->valores[0]), "%s", tok);
+    return p->n;
+}
+
+// Aplica una lista "clave=valor clave=valor" a la corrida
+static int aplicar_texto(const api_t *api, sim_t *s, const char *texto) {
+    char copia[LARGO_TEXTO], *tok, *resto, *igual;
+
+    snprintf(copia, sizeof(copia), "%s", texto);
+    for (tok = strtok_r(copia, " \t\r\n", &resto); tok; tok = strtok_r(NULL, " \t\r\n", &resto))
+    {
+        igual = strchr(tok, '=');
+        if (!igual)
+            return 0;
+        *igual = '\0';
+        if (!api->parametro(s, tok, igual + 1))
+            return 0;
+    }
+    return 1;
+}
+
+// Índice de valor del parámetro i dentro de la combinación c
+static int indice_valor(uint32_t c, int i) {
+    int j;
+    for (j = n_params - 1; j > i; j--)
+        c /= (uint32_t)params[j].n;
+    return (int)(c % (uint32_t)params[i].n);
+}
+
+static void aplicar_combinacion(const api_t *api, sim_t *s, uint32_t c) {
+    int i;
+    for (i = 0; i < n_params; i++)
+        api->parametro(s, params[i].clave, params[i].valores[indice_valor(c, i)]);
+}
+
+static int leer_escenarios(const char *archivo) {
+    char linea[LARGO_TEXTO + 40], *p;
+    FILE *f = fopen(archivo, "r");
+
+    if (!f)
+        return 0;
+    n_escenarios = 0;
+    while (fgets(linea, sizeof(linea), f) && n_escenarios < MAX_ESCENARIOS)
+    {
+        escenario_t *e = &escenarios[n_escenarios];
+        p = linea + strspn(linea, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        if (sscanf(p, "%31s", e->nombre) != 1)
+            continue;
+        p += strlen(e->nombre);
+        snprintf(e->texto, sizeof(e->texto), "%s", p);
+        n_escenarios++;
+    }
+    fclose(f);
+    return n_escenarios;
+}
+
+// --- POOL ---
+
+static int tomar(int id, uint32_t *trabajo) {
+    cola_t *c;
+    int i, ok = 0;
+
+    c = &colas[id];
+    pthread_mutex_lock(&c->m);
+    if (c->fin > c->ini)
+    {
+        *trabajo = c->trabajos[--c->fin];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&c->m);
+    if (ok)
+        return 1;
+
+    // Robo: el trabajo más antiguo de la primera cola que tenga
+    for (i = 1; i < n_hilos; i++)
+    {
+        cola_t *v = &colas[(id + i) % n_hilos];
+        pthread_mutex_lock(&v->m);
+        if (v->fin > v->ini)
+        {
+            *trabajo = v->trabajos[v->ini++];
+            ok = 1;
+        }
+        pthread_mutex_unlock(&v->m);
+        if (ok)
+        {
+            colas[id].robados++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char *texto_fijo;
+
+static void *trabajador(void *arg) {
+    int id = (int)(intptr_t)arg;
+    sim_t *s = malloc(sizeof(sim_t));
+    uint32_t j;
+    void *h;
+    api_t api;
+
+    while (s && tomar(id, &j))
+    {
+        uint32_t c = j / (uint32_t)n_escenarios;
+        int e = (int)(j % (uint32_t)n_escenarios);
+
+        if (!biblioteca_cargar(colas[id].biblioteca, &h, &api))
+        {
+            fprintf(stderr, "hilo %d: %s\n", id, dlerror());
+            break;
+        }
+        api.defecto(s);
+        aplicar_texto(&api, s, texto_fijo);
+        aplicar_texto(&api, s, escenarios[e].texto);
+        aplicar_combinacion(&api, s, c);
+        api.correr(s);
+        api.metricas(s, &resultados[j]);
+        dlclose(h);
+        colas[id].hechos++;
+    }
+    free(s);
+    return NULL;
+}
+
+static double reloj_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reparte los trabajos en bloques contiguos y corre el pool. Devuelve el tiempo de pared.
+static double correr_pool(int hilos, uint32_t n_trabajos) {
+    pthread_t t[MAX_HILOS];
+    uint32_t j, por_hilo;
+    double t0;
+    int i;
+
+    n_hilos = hilos;
+    por_hilo = (n_trabajos + (uint32_t)hilos - 1) / (uint32_t)hilos;
+    for (i = 0; i < hilos; i++)
+    {
+        cola_t *c = &colas[i];
+        c->ini = 0;
+        c->fin = 0;
+        c->hechos = 0;
+        c->robados = 0;
+        for (j = (uint32_t)i * por_hilo; j < n_trabajos && j < (uint32_t)(i + 1) * por_hilo; j++)
+            c->trabajos[c->fin++] = j;
+    }
+
+    t0 = reloj_s();
+    for (i = 0; i < hilos; i++)
+        pthread_create(&t[i], NULL, trabajador, (void *)(intptr_t)i);
+    for (i = 0; i < hilos; i++)
+        pthread_join(t[i], NULL);
+    return reloj_s() - t0;
+}
+
+// --- RANKING ---
+
+typedef struct {
+    uint32_t c;
+    uint32_t disparos;
+    int sin_establecer;
+    double t_est, sobrepico, thd, v_min, v_max;
+} fila_t;
+
+static int comparar(const void *a, const void *b) {
+    const fila_t *x = a, *y = b;
+    if (x->disparos != y->disparos)
+        return x->disparos < y->disparos ? -1 : 1;
+    if (x->sin_establecer != y->sin_establecer)
+        return x->sin_establecer < y->sin_establecer ? -1 : 1;
+    if (x->t_est != y->t_est)
+        return x->t_est < y->t_est ? -1 : 1;
+    if (x->sobrepico != y->sobrepico)
+        return x->sobrepico < y->sobrepico ? -1 : 1;
+    if (x->thd != y->thd)
+        return x->thd < y->thd ? -1 : 1;
+    return (x->c > y->c) - (x->c < y->c);
+}
+
+static void agrupar(fila_t *f, uint32_t c) {
+    int e;
+
+    memset(f, 0, sizeof(*f));
+    f->c = c;
+    f->v_min = 1e9;
+    for (e = 0; e < n_escenarios; e++)
+    {
+        const sim_metricas_t *m = &resultados[c * (uint32_t)n_escenarios + (uint32_t)e];
+        f->disparos += m->disparos;
+        if (m->t_establecimiento < 0.0)
+            f->sin_establecer++;
+        else if (m->t_establecimiento > f->t_est)
+            f->t_est = m->t_establecimiento;
+        if (m->sobrepico > f->sobrepico) f->sobrepico = m->sobrepico;
+        if (m->thd > f->thd) f->thd = m->thd;
+        if (m->vrms < f->v_min) f->v_min = m->vrms;
+        if (m->vrms > f->v_max) f->v_max = m->vrms;
+    }
+}
+
+static void imprimir_combinacion(FILE *f, uint32_t c, const char *sep) {
+    int i;
+    for (i = 0; i < n_params; i++)
+        fprintf(f, "%s%s", params[i].valores[indice_valor(c, i)], sep);
+}
+
+// --- MAIN ---
+
+int main(int argc, char **argv) {
+    const char *archivo_esc = "sim/escenarios.txt";
+    const char *archivo_csv = NULL;
+    char biblioteca[512], fijo[LARGO_TEXTO] = "";
+    int hilos = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int top = 20, escalado = 0;
+    uint32_t n_trabajos, c, j;
+    fila_t *filas;
+    double t_pared;
+    void *h;
+    api_t api;
+    sim_t *prueba;
+    int i, e;
+
+    biblioteca_ruta(biblioteca, sizeof(biblioteca));
+
+    for (i = 1; i < argc; i++)
+    {
+        char *igual = strchr(argv[i], '=');
+        size_t n = igual ? (size_t)(igual - argv[i]) : 0;
+
+        if (!igual || n == 0 || n >= sizeof(params[0].clave))
+        {
+            fprintf(stderr, "parámetro inválido: %s\n", argv[i]);
+            return 1;
+        }
+        if (!strncmp(argv[i], "hilos=", 6))           hilos = atoi(igual + 1);
+        else if (!strncmp(argv[i], "escenarios=", 11)) archivo_esc = igual + 1;
+        else if (!strncmp(argv[i], "top=", 4))         top = atoi(igual + 1);
+        else if (!strncmp(argv[i], "csv=", 4))         archivo_csv = igual + 1;
+        else if (!strncmp(argv[i], "escalado=", 9))    escalado = atoi(igual + 1);
+        else if (!strncmp(argv[i], "biblioteca=", 11)) snprintf(biblioteca, sizeof(biblioteca), "%s", igual + 1);
+        else if (strchr(igual + 1, ',') || strchr(igual + 1, ':'))
+        {
+            param_t *p = &params[n_params];
+            if (n_params >= MAX_PARAMS)
+            {
+                fprintf(stderr, "demasiados parámetros barridos\n");
+                return 1;
+            }
+            memcpy(p->clave, argv[i], n);
+            p->clave[n] = '\0';
+            if (expandir(p, igual + 1) == 0)
+            {
+                fprintf(stderr, "lista vacía: %s\n", argv[i]);
+                return 1;
+            }
+            n_params++;
+        }
+        else
+        {
+            // Valor único: se aplica a todas las corridas
+            strncat(fijo, " ", sizeof(fijo) - strlen(fijo) - 1);
+            strncat(fijo, argv[i], sizeof(fijo) - strlen(fijo) - 1);
+        }
+    }
+    if (hilos < 1) hilos = 1;
+    if (hilos > MAX_HILOS) hilos = MAX_HILOS;
+    texto_fijo = fijo;
+
+    if (!leer_escenarios(archivo_esc))
+    {
+        fprintf(stderr, "sin escenarios en %s\n", archivo_esc);
+        return 1;
+    }
+
+    // Validación de claves con una instancia de la biblioteca
+    if (!biblioteca_cargar(biblioteca, &h, &api))
+    {
+        fprintf(stderr, "no se pudo cargar %s: %s\n", biblioteca, dlerror());
+        return 1;
+    }
+    prueba = malloc(sizeof(sim_t));
+    api.defecto(prueba);
+    if (!aplicar_texto(&api, prueba, fijo))
+    {
+        fprintf(stderr, "parámetro desconocido en:%s\n", fijo);
+        return 1;
+    }
+    for (e = 0; e < n_escenarios; e++)
+        if (!aplicar_texto(&api, prueba, escenarios[e].texto))
+        {
+            fprintf(stderr, "escenario %s: parámetro desconocido\n", escenarios[e].nombre);
+            return 1;
+        }
+    for (i = 0; i < n_params; i++)
+        if (!api.parametro(prueba, params[i].clave, params[i].valores[0]))
+        {
+            fprintf(stderr, "parámetro desconocido: %s\n", params[i].clave);
+            return 1;
+        }
+    free(prueba);
+    dlclose(h);
+
+    n_combinaciones = 1;
+    for (i = 0; i < n_params; i++)
+        n_combinaciones *= (uint32_t)params[i].n;
+    n_trabajos = n_combinaciones * (uint32_t)n_escenarios;
+    resultados = calloc(n_trabajos, sizeof(sim_metricas_t));
+
+    for (i = 0; i < hilos; i++)
+    {
+        pthread_mutex_init(&colas[i].m, NULL);
+        colas[i].trabajos = malloc(n_trabajos * sizeof(uint32_t));
+        if (!biblioteca_copiar(biblioteca, colas[i].biblioteca, sizeof(colas[i].biblioteca)))
+        {
+            fprintf(stderr, "no se pudo copiar %s\n", biblioteca);
+            return 1;
+        }
+    }
+
+    printf("Barrido: %u combinaciones x %d escenarios = %u corridas, %d hilos\n",
+           n_combinaciones, n_escenarios, n_trabajos, hilos);
+
+    // Escalado: el mismo barrido con 1, 2, 4... hilos
+    if (escalado)
+    {
+        double t1 = 0.0;
+        int k = 1;
+        while (1)
+        {
+            t_pared = correr_pool(k, n_trabajos);
+            if (k == 1)
+                t1 = t_pared;
+            printf("  %3d hilos: %8.2f s  %7.1f corridas/s  aceleración %.2fx  eficiencia %3.0f %%\n",
+                   k, t_pared, n_trabajos / t_pared, t1 / t_pared, 100.0 * t1 / t_pared / k);
+            if (k == hilos)
+                break;
+            k = (k * 2 < hilos) ? k * 2 : hilos;
+        }
+    }
+    else
+    {
+        t_pared = correr_pool(hilos, n_trabajos);
+        printf("Tiempo: %.2f s, %.1f corridas/s\n", t_pared, n_trabajos / t_pared);
+        for (i = 0; i < hilos; i++)
+            printf("  hilo %d: %u corridas, %u robadas\n", i, colas[i].hechos, colas[i].robados);
+    }
+
+    for (i = 0; i < hilos; i++)
+    {
+        unlink(colas[i].biblioteca);
+        free(colas[i].trabajos);
+    }
+
+    // Tabla ordenada
+    filas = malloc(n_combinaciones * sizeof(fila_t));
+    for (c = 0; c < n_combinaciones; c++)
+        agrupar(&filas[c], c);
+    qsort(filas, n_combinaciones, sizeof(fila_t), comparar);
+
+    printf("\n%4s ", "#");
+    for (i = 0; i < n_params; i++)
+        printf("%8s ", params[i].clave);
+    printf("%8s %6s %8s %9s %6s %15s\n", "disparos", "s/est", "t_est[s]", "sobrep[%]", "THD[%]", "Vrms[min-max]");
+    for (c = 0; c < n_combinaciones && (int)c < top; c++)
+    {
+        fila_t *f = &filas[c];
+        printf("%4u ", c + 1);
+        for (i = 0; i < n_params; i++)
+            printf("%8s ", params[i].valores[indice_valor(f->c, i)]);
+        printf("%8u %6d %8.3f %9.1f %6.2f %7.1f-%-7.1f\n",
+               f->disparos, f->sin_establecer, f->t_est, f->sobrepico, f->thd, f->v_min, f->v_max);
+    }
+
+    // Detalle por corrida
+    if (archivo_csv)
+    {
+        FILE *f = fopen(archivo_csv, "w");
+        if (f)
+        {
+            for (i = 0; i < n_params; i++)
+                fprintf(f, "%s,", params[i].clave);
+            fprintf(f, "escenario,vrms,t_establecimiento,sobrepico,thd,disparos\n");
+            for (j = 0; j < n_trabajos; j++)
+            {
+                const sim_metricas_t *m = &resultados[j];
+                imprimir_combinacion(f, j / (uint32_t)n_escenarios, ",");
+                fprintf(f, "%s,%.2f,%.4f,%.2f,%.3f,%u\n", escenarios[j % (uint32_t)n_escenarios].nombre,
+                        m->vrms, m->t_establecimiento, m->sobrepico, m->thd, m->disparos);
+            }
+            fclose(f);
+        }
+    }
+
+    free(filas);
+    free(resultados);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file biblioteca.c
+ * @brief Carga y copia de _sim/libinversor.so (ver biblioteca.h).
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "biblioteca.h"
+
+// _sim/libinversor.so junto al ejecutable (o relativa al directorio actual)
+void biblioteca_ruta(char *ruta, size_t largo) {
+    char exe[400];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+
+    snprintf(ruta, largo, "_sim/libinversor.so");
+    if (n > 0)
+    {
+        exe[n] = '\0';
+        if (strrchr(exe, '/'))
+            *strrchr(exe, '/') = '\0';
+        snprintf(ruta, largo, "%s/_sim/libinversor.so", exe);
+    }
+}
+
+int biblioteca_cargar(const char *ruta, void **h, api_t *api) {
+    *h = dlopen(ruta, RTLD_NOW | RTLD_LOCAL);
+    if (!*h)
+        return 0;
+    api->defecto = (void (*)(sim_t *))dlsym(*h, "sim_defecto");
+    api->parametro = (int (*)(sim_t *, const char *, const char *))dlsym(*h, "sim_parametro");
+    api->correr = (void (*)(sim_t *))dlsym(*h, "sim_correr");
+    api->metricas = (void (*)(const sim_t *, sim_metricas_t *))dlsym(*h, "sim_metricas");
+    return api->defecto && api->parametro && api->correr && api->metricas;
+}
+
+// Copia para una instancia (dlopen() de la misma ruta comparte globales)
+int biblioteca_copiar(const char *origen, char *destino, size_t largo) {
+    char buf[65536];
+    size_t n;
+    int fd;
+    FILE *in, *out;
+
+    // Un TMPDIR largo no entra: mejor fallar acá que con la plantilla recortada
+    if ((size_t)snprintf(destino, largo, "%s/inversor_XXXXXX.so",
+                         getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp") >= largo)
+        return 0;
+    fd = mkstemps(destino, 3);
+    if (fd < 0)
+        return 0;
+    in = fopen(origen, "rb");
+    out = fdopen(fd, "wb");
+    if (!in || !out)
+    {
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return 0;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        fwrite(buf, 1, n, out);
+    fclose(in);
+    return fclose(out) == 0;
+}
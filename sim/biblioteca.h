@@ -0,0 +1,26 @@
+/**
+ * @file biblioteca.h
+ * @brief Copias de _sim/libinversor.so para correr varias instancias del firmware
+ * en un proceso (barrido.c, paralelo.c). El firmware vive en variables globales:
+ * dlopen() de un archivo distinto da globales (firmware y registros) propias.
+ */
+
+#ifndef BIBLIOTECA_H
+#define BIBLIOTECA_H
+
+#include <stddef.h>
+#include "simulador.h"
+
+// Entradas de la biblioteca del simulador
+typedef struct {
+    void (*defecto)(sim_t *);
+    int (*parametro)(sim_t *, const char *, const char *);
+    void (*correr)(sim_t *);
+    void (*metricas)(const sim_t *, sim_metricas_t *);
+} api_t;
+
+void biblioteca_ruta(char *ruta, size_t largo);
+int biblioteca_cargar(const char *ruta, void **h, api_t *api);
+int biblioteca_copiar(const char *origen, char *destino, size_t largo);
+
+#endif // BIBLIOTECA_H
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Compila el simulador de host con el firmware real (src/) y el modelo (sim/).
+# main.c se compila aparte para renombrar su main() a main_firmware().
+#   ./inversor_sim          una corrida (principal.c)
+#   _sim/libinversor.so     firmware + modelo, una copia por hilo del barrido
+#   ./inversor_barrido      barrido paralelo de parámetros (barrido.c)
+#   ./inversor_paralelo     varias unidades en un bus común (paralelo.c)
+#   ./inversor_registro     decodificador del registro de eventos (registro.c)
+# sim/compilar.sh verificar: además corre las verificaciones del final y sale con
+# error si alguna no se cumple.
+set -e
+cd "$(dirname "$0")/.."
+CC=${CC:-gcc}
+CFLAGS="${CFLAGS:--O2} -std=gnu99 -DSIMULADOR -Isim -Iinclude"
+FUENTES="src/drivers.c src/control.c src/pwm.c sim/perifericos.c sim/planta.c sim/simulador.c"
+mkdir -p _sim
+$CC $CFLAGS -Dmain=main_firmware -c src/main.c -o _sim/main_fw.o
+$CC $CFLAGS _sim/main_fw.o $FUENTES sim/principal.c -lm -o inversor_sim
+
+$CC $CFLAGS -fPIC -Dmain=main_firmware -c src/main.c -o _sim/main_fw_pic.o
+$CC $CFLAGS -fPIC -shared -Wl,-Bsymbolic _sim/main_fw_pic.o $FUENTES -lm -o _sim/libinversor.so
+$CC $CFLAGS sim/barrido.c sim/biblioteca.c -lpthread -ldl -lm -o inversor_barrido
+$CC $CFLAGS sim/paralelo.c sim/biblioteca.c -lpthread -ldl -lm -o inversor_paralelo
+$CC $CFLAGS sim/registro.c -o inversor_registro
+
+[ "${1:-}" = verificar ] || exit 0
+falla() { echo "FALLA: $*"; exit 1; }
+
+# Bucle principal atrasado 35 ms (pasa K a 3): la protección por corriente sigue
+# corriendo y corta un cortocircuito de 3 ohm aplicado 0,1 s después en < 0,2 s
+t=$(./inversor_sim t=2 carga=r r=3 t_carga=1.1 atasco=0.035 t_atasco=1.0 | sed -n 's/^Primer disparo: \([0-9.]*\) s$/\1/p')
+[ -n "$t" ] || falla "atasco: sin disparo"
+awk "BEGIN { exit !($t < 1.3) }" || falla "atasco: disparo en $t s"
+echo "atasco: disparo en $t s"
+
+# Falla por hardware: la ISR de INT0 corta el PWM en la latencia de interrupción
+# más unas instrucciones (6,6 us en el modelo), con el bucle en cualquier punto
+# del ciclo: en marcha, en plena rampa de encendido y con carga. Tope: 10 us.
+for f in "t=1.2 falla=1.0" "t=1.2 falla=1.00731" "t=0.5 falla=0.1" "t=1.2 carga=r r=53 falla=1.0113"; do
+    l=$(./inversor_sim $f | sed -n 's/^Falla en .* PWM cortado en \([0-9.]*\) us$/\1/p')
+    [ -n "$l" ] || falla "latencia ($f): PWM no cortado por la ISR"
+    awk "BEGIN { exit !($l <= 10.0) }" || falla "latencia ($f): $l us"
+done
+echo "latencia de la falla: <= 10 us"
+
+# Registro de eventos: 17 arranques dan la vuelta al anillo y el 18.º se corta a
+# los 20 ms, con el registro de la posición 1 a medio escribir. Tiene que quedar
+# como posición vacía (15 eventos), no como el registro viejo con datos nuevos.
+ee=_sim/verificar_ee.bin
+rm -f $ee
+for n in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17; do
+    ./inversor_sim t=0.2 eeprom=$ee >/dev/null
+done
+./inversor_sim t=0.02 eeprom=$ee >/dev/null
+n=$(./inversor_registro $ee | sed -n 's/^\([0-9]*\) eventos$/\1/p')
+[ "$n" = 15 ] || falla "registro cortado: $n eventos"
+./inversor_sim t=0.2 eeprom=$ee >/dev/null
+n=$(./inversor_registro $ee | sed -n 's/^\([0-9]*\) eventos$/\1/p')
+[ "$n" = 16 ] || falla "registro tras el corte: $n eventos"
+echo "registro cortado: posición vacía, el arranque siguiente la vuelve a escribir"
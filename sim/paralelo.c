@@ -0,0 +1,481 @@
+/**
+ * @file paralelo.c
+ * @brief Varias unidades en paralelo sobre un bus común: una copia del firmware por
+ * unidad, cada una en su hilo, avanzando juntas tick a tick.
+ *
+ * Cada hilo carga su copia de _sim/libinversor.so (biblioteca.c) y corre la
+ * planta con CARGA_BUS: los capacitores del filtro quedan en paralelo sobre la
+ * carga común. Al final de cada tick las unidades publican su il y, pasada una
+ * barrera, todas calculan el mismo v del bus (trapecio sobre N cf y la carga) y
+ * la corriente de las demás para el tick siguiente (extrapolada a mitad de tick).
+ * Las unidades se diferencian en el error de ganancia del sensado de tensión y en
+ * el instante en que salen del reset.
+ * Con maestro= la unidad 0 corre otra biblioteca (SINCRONISMO=1) y las demás
+ * ven su SYNC_OSC en RB7 desde el tick siguiente (SINCRONISMO=2).
+ *
+ * Compilación: CFLAGS="-O2 -DPARALELO=1" sim/compilar.sh  (sin PARALELO, sin caída)
+ * Sincronismo: CFLAGS="-DSINCRONISMO=1" sim/compilar.sh && cp _sim/libinversor.so _sim/maestro.so
+ *              CFLAGS="-DSINCRONISMO=2" sim/compilar.sh
+ * Uso: ./inversor_paralelo [unidades=4] [tolerancia=0.01] [desfase=0.0001]
+ *                          [escalado=1] [traza=<prefijo>] [maestro=<biblioteca>]
+ *                          [bus=1] [fase=0] [retraso_maestro=0] [clave=valor ...]
+ *   r: carga por unidad (la común es r / unidades); t_carga, t_descarga, t_recarga: la común
+ *   tolerancia: error de k_v (AN0), repartido de -tol a +tol entre las unidades
+ *   desfase: las unidades salen del reset repartidas en desfase [s] (la última,
+ *     desfase después de la primera). Más de ~0,2 ms sin sincronismo: el
+ *     arranque se dispara
+ *   escalado: la misma corrida con 1, 2, 4... hasta unidades
+ *   traza: un CSV por ciclo y por unidad en <prefijo><k>.csv (como en principal.c)
+ *   maestro: biblioteca de la unidad 0
+ *   bus=0: cada unidad con su carga (r, carga=...), solo comparten el sincronismo
+ *   fase: atraso esperado de los esclavos [°] (180 con SINC_DESFASE=196)
+ *   retraso_maestro: el maestro sale del reset retraso_maestro [s] después
+ *   Claves: las de simulador.c (t=4 por defecto).
+ * Reparto: Irms y potencia activa de cada unidad en el último segundo;
+ * error = máx |x - media| / media.
+ * Sincronismo: fase del puente (cruce de d1 - d2 hacia positivo, resolución de un
+ * tick) de cada esclavo contra el cruce más cercano del maestro, menos fase.
+ * Enganche: desde el primer pulso del maestro hasta el cruce que sigue al último
+ * error de más de SINC_UMBRAL ticks; residual: error medio y máximo del último
+ * segundo. Al lado, SINC_ERROR y SINC_ENGANCHE del firmware de cada esclavo al
+ * terminar (lo que manda en la trama).
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "simulador.h"
+#include "biblioteca.h"
+
+#define MAX_UNIDADES    16
+#define MAX_CLAVES      32
+#define MAX_CRUCES      2048        // Ciclos registrados por unidad (~40 s)
+#define TICKS_CICLO     392
+#define SINC_UMBRAL     3           // Ticks: "enganchado"
+
+typedef struct {
+    char biblioteca[512];
+    sim_t *s;
+    int sinc_enganche;      // SINC_ENGANCHE del firmware al terminar; < 0: no es esclavo
+    int sinc_error;         // SINC_ERROR del firmware al terminar [ticks]
+} unidad_t;
+
+typedef struct {
+    double irms[MAX_UNIDADES], p[MAX_UNIDADES];
+    double vrms, frecuencia, thd, error, error_p;
+    uint32_t disparos;
+    double enganche[MAX_UNIDADES];          // [s] desde el primer cruce del maestro; < 0: nunca
+    double fase_media[MAX_UNIDADES], fase_max[MAX_UNIDADES];    // [ticks]
+} resultado_t;
+
+static unidad_t unidades[MAX_UNIDADES];
+static int n_unidades;
+static pthread_barrier_t barrera;
+static double il_pub[3][MAX_UNIDADES];     // il al final de cada tick (3 para no pisar al lento)
+static double v_bus[MAX_UNIDADES];          // Copia del bus por hilo: todas iguales
+static double c_bus;
+static uint32_t ticks_prom;                 // Desde acá se promedian Irms y P (último segundo)
+static double suma_i2[MAX_UNIDADES], suma_p[MAX_UNIDADES];
+static uint32_t n_prom[MAX_UNIDADES];
+static uint8_t sync_pub[3];                 // SYNC_OSC del maestro al final de cada tick
+static uint32_t primer_pulso;               // Tick del primer pulso del maestro (0: ninguno)
+static uint32_t cruces[MAX_UNIDADES][MAX_CRUCES];   // Tick de cada cruce del puente
+static int n_cruces[MAX_UNIDADES];
+static double puente_ant[MAX_UNIDADES];
+
+static char *claves[MAX_CLAVES];            // clave=valor para simulador.c
+static int n_claves;
+static double tolerancia = 0.01;
+static double desfase = 0.0001;
+static const char *traza;                   // Prefijo de las trazas por unidad
+static const char *maestro;                 // Biblioteca de la unidad 0 (sincronismo)
+static int bus = 1;
+static double fase;
+static double retraso_maestro;
+
+// Fin de tick, en el hilo de cada unidad
+static void sincronizar(sim_t *s) {
+    planta_t *p = &s->planta;
+    int k = s->unidad, j;
+    double *act = il_pub[s->ticks % 3];
+    double *ant = il_pub[(s->ticks + 2) % 3];
+    double dt = SIM_T_TICK_US * 1e-6;
+    double q = 0.0, otros = 0.0, g, puente = s->d1 - s->d2;
+
+    if (s->ticks >= ticks_prom)
+    {
+        suma_i2[k] += p->io * p->io;
+        suma_p[k] += p->vc * p->io;
+        n_prom[k]++;
+    }
+    if (puente > 0.0 && puente_ant[k] < 0.0 && n_cruces[k] < MAX_CRUCES)
+        cruces[k][n_cruces[k]++] = s->ticks;
+    if (puente != 0.0)
+        puente_ant[k] = puente;
+    act[k] = p->il;
+    if (k == 0)
+    {
+        sync_pub[s->ticks % 3] = s->sync_salida;
+        if (s->sync_salida && !primer_pulso)
+            primer_pulso = s->ticks;
+    }
+    pthread_barrier_wait(&barrera);
+
+    s->sync_entrada = maestro ? sync_pub[s->ticks % 3] : 0;
+    if (!bus)
+        return;
+
+    for (j = 0; j < n_unidades; j++)
+    {
+        q += 0.5 * (act[j] + ant[j]) * dt;
+        if (j != k)
+            otros += 1.5 * act[j] - 0.5 * ant[j];
+    }
+    g = planta_conectada(p) ? 1.0 / p->r : 0.0;
+    v_bus[k] = (v_bus[k] * (c_bus - 0.5 * dt * g) + q) / (c_bus + 0.5 * dt * g);
+    p->vc = v_bus[k];
+    p->i_otros = otros;
+}
+
+static void *correr_unidad(void *arg) {
+    unidad_t *u = arg;
+    void *h;
+    api_t api;
+    const volatile int16_t *e;
+    const volatile uint8_t *g;
+
+    if (!biblioteca_cargar(u->biblioteca, &h, &api))
+    {
+        fprintf(stderr, "unidad %d: %s\n", u->s->unidad, dlerror());
+        exit(1);
+    }
+    api.correr(u->s);
+
+    // Lo que mide el propio esclavo (SINCRONISMO=2), para comparar con los cruces
+    e = dlsym(h, "SINC_ERROR");
+    g = dlsym(h, "SINC_ENGANCHE");
+    u->sinc_enganche = -1;
+    if (e && g)
+    {
+        u->sinc_error = *e;
+        u->sinc_enganche = *g;
+    }
+    dlclose(h);
+    return NULL;
+}
+
+// Error de fase del esclavo k en cada uno de sus cruces, contra el cruce más
+// cercano del maestro. Enganche: el primer cruce después del último fuera de
+// SINC_UMBRAL, contado desde el primer pulso del maestro.
+static void medir_fase(int k, resultado_t *res) {
+    int32_t objetivo = (int32_t)(fase / 360.0 * TICKS_CICLO + 0.5);
+    int i, j, n = 0, enganchado = -1;
+    double suma = 0.0;
+
+    res->enganche[k] = -1.0;
+    for (i = 0; i < n_cruces[k] && n_cruces[0] && primer_pulso; i++)
+    {
+        int32_t e = 0, x;
+
+        if (cruces[k][i] < cruces[0][0])
+            continue;               // El maestro todavía no arrancó
+        for (j = 0; j < n_cruces[0]; j++)
+        {
+            x = (int32_t)cruces[k][i] - (int32_t)cruces[0][j] - objetivo;
+            if (j == 0 || abs(x) < abs(e))
+                e = x;
+        }
+        if (abs(e) > SINC_UMBRAL)
+            enganchado = -1;
+        else if (enganchado < 0)
+            enganchado = i;
+        if (cruces[k][i] >= ticks_prom)
+        {
+            suma += e;
+            if (fabs((double)e) > res->fase_max[k])
+                res->fase_max[k] = fabs((double)e);
+            n++;
+        }
+    }
+    if (enganchado >= 0)
+        res->enganche[k] = (cruces[k][enganchado] - primer_pulso) * SIM_T_TICK_US * 1e-6;
+    res->fase_media[k] = n ? suma / n : 0.0;
+}
+
+// Una corrida con n unidades
+static int correr(const char *biblioteca, int n, resultado_t *res) {
+    pthread_t hilos[MAX_UNIDADES];
+    void *h;
+    api_t api;
+    double media = 0.0, media_p = 0.0;
+    int k, i;
+
+    if (!biblioteca_cargar(biblioteca, &h, &api))
+        return 0;
+    n_unidades = n;
+    memset(il_pub, 0, sizeof(il_pub));
+    memset(v_bus, 0, sizeof(v_bus));
+    memset(suma_i2, 0, sizeof(suma_i2));
+    memset(suma_p, 0, sizeof(suma_p));
+    memset(n_prom, 0, sizeof(n_prom));
+    memset(sync_pub, 0, sizeof(sync_pub));
+    primer_pulso = 0;
+    memset(n_cruces, 0, sizeof(n_cruces));
+    memset(puente_ant, 0, sizeof(puente_ant));
+    for (k = 0; k < n; k++)
+    {
+        sim_t *s = unidades[k].s;
+        double x = (n > 1) ? 2.0 * k / (n - 1) - 1.0 : 0.0;
+
+        api.defecto(s);
+        s->ticks_fin = (uint32_t)(4.0e6 / SIM_T_TICK_US);
+        for (i = 0; i < n_claves; i++)
+        {
+            char *igual = strchr(claves[i], '=');
+            *igual = '\0';
+            api.parametro(s, claves[i], igual + 1);
+            *igual = '=';
+        }
+        if (bus)
+        {
+            s->planta.tipo = CARGA_BUS;
+            s->planta.unidades = n;
+            s->planta.r /= n;
+        }
+        s->k_v *= 1.0 + tolerancia * x;
+        s->ticks_reset += (uint32_t)(((n > 1 ? k * desfase / (n - 1) : 0.0) + (k ? 0.0 : retraso_maestro))
+                                     * 1e6 / SIM_T_TICK_US + 0.5);
+        s->unidad = k;
+        s->sincronizar = sincronizar;
+        if (traza)
+        {
+            char ruta[512];
+
+            snprintf(ruta, sizeof(ruta), "%s%d.csv", traza, k);
+            s->traza = fopen(ruta, "w");
+            if (s->traza)
+                fprintf(s->traza, "t,vrms,irms,v_pico,v_salida,i_salida,estado,previo,vbus\n");
+        }
+    }
+    c_bus = n * unidades[0].s->planta.cf;
+    ticks_prom = unidades[0].s->ticks_fin > (uint32_t)(1e6 / SIM_T_TICK_US) ?
+                 unidades[0].s->ticks_fin - (uint32_t)(1e6 / SIM_T_TICK_US) : 0;
+    dlclose(h);
+
+    pthread_barrier_init(&barrera, NULL, (unsigned)n);
+    for (k = 0; k < n; k++)
+        pthread_create(&hilos[k], NULL, correr_unidad, &unidades[k]);
+    for (k = 0; k < n; k++)
+        pthread_join(hilos[k], NULL);
+    pthread_barrier_destroy(&barrera);
+    for (k = 0; k < n; k++)
+        if (unidades[k].s->traza)
+            fclose(unidades[k].s->traza);
+
+    memset(res, 0, sizeof(*res));
+    for (k = 0; k < n; k++)
+    {
+        if (n_prom[k])
+        {
+            res->irms[k] = sqrt(suma_i2[k] / n_prom[k]);
+            res->p[k] = suma_p[k] / n_prom[k];
+        }
+        res->disparos += unidades[k].s->disparos;
+        media += res->irms[k] / n;
+        media_p += res->p[k] / n;
+    }
+    for (k = 0; k < n; k++)
+    {
+        if (media > 0.0 && fabs(res->irms[k] - media) / media > res->error)
+            res->error = fabs(res->irms[k] - media) / media;
+        if (media_p > 0.0 && fabs(res->p[k] - media_p) / media_p > res->error_p)
+            res->error_p = fabs(res->p[k] - media_p) / media_p;
+    }
+    res->error *= 100.0;
+    res->error_p *= 100.0;
+    if (maestro)
+        for (k = 1; k < n; k++)
+            medir_fase(k, res);
+
+    // Bus y frecuencia de la unidad 0 (el bus es el mismo para todas)
+    {
+        const sim_t *s = unidades[0].s;
+        sim_metricas_t m;
+        uint32_t c = s->ciclos < SIM_MAX_CICLOS ? s->ciclos : SIM_MAX_CICLOS;
+
+        biblioteca_cargar(biblioteca, &h, &api);
+        api.metricas(s, &m);
+        dlclose(h);
+        res->vrms = m.vrms;
+        res->thd = m.thd;
+        if (c > 11)
+            res->frecuencia = 10.0 / (s->t_ciclo[c - 1] - s->t_ciclo[c - 11]);
+    }
+    return 1;
+}
+
+static double reloj_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    char biblioteca[512];
+    int maximo = 4, escalado = 0;
+    resultado_t res;
+    double t0;
+    int i, k, n;
+
+    biblioteca_ruta(biblioteca, sizeof(biblioteca));
+    for (i = 1; i < argc; i++)
+    {
+        char *igual = strchr(argv[i], '=');
+
+        if (!igual || igual == argv[i])
+        {
+            fprintf(stderr, "parámetro inválido: %s\n", argv[i]);
+            return 1;
+        }
+        if (!strncmp(argv[i], "unidades=", 9)) maximo = atoi(igual + 1);
+        else if (!strncmp(argv[i], "tolerancia=", 11)) tolerancia = atof(igual + 1);
+        else if (!strncmp(argv[i], "desfase=", 8)) desfase = atof(igual + 1);
+        else if (!strncmp(argv[i], "escalado=", 9)) escalado = atoi(igual + 1);
+        else if (!strncmp(argv[i], "traza=", 6)) traza = igual + 1;
+        else if (!strncmp(argv[i], "maestro=", 8)) maestro = igual + 1;
+        else if (!strncmp(argv[i], "bus=", 4)) bus = atoi(igual + 1);
+        else if (!strncmp(argv[i], "fase=", 5)) fase = atof(igual + 1);
+        else if (!strncmp(argv[i], "retraso_maestro=", 16)) retraso_maestro = atof(igual + 1);
+        else if (!strncmp(argv[i], "biblioteca=", 11)) snprintf(biblioteca, sizeof(biblioteca), "%s", igual + 1);
+        else if (n_claves < MAX_CLAVES) claves[n_claves++] = argv[i];
+    }
+    if (maximo < 1 || maximo > MAX_UNIDADES)
+    {
+        fprintf(stderr, "unidades: 1 a %d\n", MAX_UNIDADES);
+        return 1;
+    }
+
+    // Validación de claves con una instancia
+    {
+        void *h;
+        api_t api;
+        sim_t *s = malloc(sizeof(sim_t));
+
+        if (!s || !biblioteca_cargar(biblioteca, &h, &api))
+        {
+            fprintf(stderr, "no se pudo cargar %s: %s\n", biblioteca, dlerror());
+            return 1;
+        }
+        api.defecto(s);
+        for (i = 0; i < n_claves; i++)
+        {
+            char *igual = strchr(claves[i], '=');
+            int ok;
+
+            *igual = '\0';
+            ok = api.parametro(s, claves[i], igual + 1);
+            *igual = '=';
+            if (!ok)
+            {
+                fprintf(stderr, "parámetro desconocido: %s\n", claves[i]);
+                return 1;
+            }
+        }
+        free(s);
+        dlclose(h);
+    }
+
+    for (k = 0; k < maximo; k++)
+    {
+        const char *origen = (k == 0 && maestro) ? maestro : biblioteca;
+
+        unidades[k].s = malloc(sizeof(sim_t));
+        if (!unidades[k].s || !biblioteca_copiar(origen, unidades[k].biblioteca, sizeof(unidades[k].biblioteca)))
+        {
+            fprintf(stderr, "no se pudo copiar %s\n", origen);
+            return 1;
+        }
+    }
+
+    printf("Tolerancia de k_v: ±%.1f %%  Desfase de arranque: %.2f ms\n",
+           tolerancia * 100.0, desfase * 1e3);
+    if (maestro)
+        printf("Sincronismo: maestro %s  Fase de los esclavos: %.0f°\n", maestro, fase);
+    if (escalado)
+        printf("%8s %9s %9s %8s %7s %10s %8s %9s%s\n", "unidades", "Vrms[V]", "f[Hz]", "THD[%]",
+               "Irms[A]", "reparto[%]", "disparos", "tiempo[s]",
+               maestro ? " enganche[s] fase[ticks]" : "");
+    for (n = escalado ? 1 : maximo; n <= maximo; n = (n * 2 < maximo || n == maximo) ? n * 2 : maximo)
+    {
+        t0 = reloj_s();
+        if (!correr(biblioteca, n, &res))
+        {
+            fprintf(stderr, "no se pudo cargar %s\n", biblioteca);
+            return 1;
+        }
+        if (escalado)
+        {
+            double media = 0.0;
+            for (k = 0; k < n; k++)
+                media += res.irms[k] / n;
+            printf("%8d %9.1f %9.2f %8.2f %7.2f %10.1f %8u %9.2f", n, res.vrms, res.frecuencia,
+                   res.thd, media, res.error, res.disparos, reloj_s() - t0);
+            if (maestro)
+            {
+                // La peor unidad: enganche más tardío (o nunca) y mayor error residual
+                double enganche = 0.0, fase_max = 0.0;
+                for (k = 1; k < n; k++)
+                {
+                    if (enganche >= 0.0 && (res.enganche[k] < 0.0 || res.enganche[k] > enganche))
+                        enganche = res.enganche[k];
+                    if (res.fase_max[k] > fase_max)
+                        fase_max = res.fase_max[k];
+                }
+                if (enganche < 0.0)
+                    printf(" %11s %11.0f", "no", fase_max);
+                else
+                    printf(" %11.3f %11.0f", enganche, fase_max);
+            }
+            printf("\n");
+        }
+        else
+        {
+            printf("Unidades: %d  Carga %s: %.2f ohm  Tiempo: %.2f s\n", n, bus ? "común" : "por unidad",
+                   unidades[0].s->planta.r, reloj_s() - t0);
+            printf("%s: %.1f Vrms  %.2f Hz  THD %.2f %%  Disparos: %u\n", bus ? "Bus" : "Unidad 0",
+                   res.vrms, res.frecuencia, res.thd, res.disparos);
+            for (k = 0; k < n; k++)
+                printf("  unidad %2d: k_v %+5.1f %%  Irms %5.2f A  P %6.0f W\n", k,
+                       (n > 1 ? 2.0 * k / (n - 1) - 1.0 : 0.0) * tolerancia * 100.0, res.irms[k], res.p[k]);
+            if (bus)
+                printf("Error de reparto: Irms %.1f %%  P %.1f %%\n", res.error, res.error_p);
+            for (k = 1; maestro && k < n; k++)
+            {
+                if (res.enganche[k] < 0.0)
+                    printf("  esclavo %2d: sin enganche", k);
+                else
+                    printf("  esclavo %2d: enganche en %.3f s", k, res.enganche[k]);
+                printf("  error residual: medio %+.2f ticks  máximo %.0f ticks (%.0f us, %.1f°)\n",
+                       res.fase_media[k], res.fase_max[k], res.fase_max[k] * SIM_T_TICK_US,
+                       res.fase_max[k] * 360.0 / TICKS_CICLO);
+                if (unidades[k].sinc_enganche >= 0)
+                    printf("              firmware: SINC_ERROR %+d ticks  SINC_ENGANCHE %d ciclos\n",
+                           unidades[k].sinc_error, unidades[k].sinc_enganche);
+            }
+        }
+        if (n == maximo)
+            break;
+    }
+
+    for (k = 0; k < maximo; k++)
+    {
+        unlink(unidades[k].biblioteca);
+        free(unidades[k].s);
+    }
+    return 0;
+}
@@ -0,0 +1,553 @@
+/**
+ * @file perifericos.c
+ * @brief Registros y periféricos del PIC18F2520 en el host.
+ * Timer2/PWM, Timer0, ADC, EEPROM de datos, interrupciones, SLEEP/IDLE, WDT y el
+ * FF de protección.
+ * El tiempo avanza por ticks de Timer2 (51,2 us); el código del firmware entre
+ * eventos de hardware se considera instantáneo, salvo conversiones A/D y demoras.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "../include/global_vars.h"
+#include "simulador.h"
+#include <xc.h>
+
+// --- Registros ---
+volatile PORTA_t sim_PORTA;     volatile PORTB_t sim_PORTB;     volatile PORTC_t sim_PORTC;
+volatile LATA_t sim_LATA;       volatile LATB_t sim_LATB;       volatile LATC_t sim_LATC;
+volatile TRISA_t sim_TRISA;     volatile TRISB_t sim_TRISB;     volatile TRISC_t sim_TRISC;
+volatile ADCON0_t sim_ADCON0;   volatile ADCON1_t sim_ADCON1;   volatile ADCON2_t sim_ADCON2;
+volatile uint8_t sim_ADRESH;    volatile uint8_t sim_ADRESL;
+volatile uint8_t sim_CCPR1L;    volatile uint8_t sim_CCPR2L;
+volatile CCP1CON_t sim_CCP1CON; volatile CCP2CON_t sim_CCP2CON;
+volatile uint8_t sim_PR2;       volatile uint8_t sim_TMR2;      volatile T2CON_t sim_T2CON;
+volatile T0CON_t sim_T0CON;     volatile sim_tmr16_t sim_TMR0;  volatile T1CON_t sim_T1CON;
+volatile INTCON_t sim_INTCON;   volatile INTCON2_t sim_INTCON2; volatile INTCON3_t sim_INTCON3;
+volatile RCON_t sim_RCON;
+volatile PIE1_t sim_PIE1;       volatile PIR1_t sim_PIR1;
+volatile PIE2_t sim_PIE2;       volatile PIR2_t sim_PIR2;
+volatile SSPCON1_t sim_SSPCON1; volatile SSPSTAT_t sim_SSPSTAT; volatile uint8_t sim_SSPBUF;
+volatile OSCCON_t sim_OSCCON;   volatile WDTCON_t sim_WDTCON;
+volatile CMCON_t sim_CMCON;     volatile CVRCON_t sim_CVRCON;   volatile HLVDCON_t sim_HLVDCON;
+volatile uint8_t sim_WREG;      volatile STATUS_t sim_STATUS;
+volatile EECON1_t sim_EECON1;   volatile uint8_t sim_EEADR;     volatile uint8_t sim_EEDATA;
+volatile uint8_t sim_EECON2;
+volatile sim_tmr16_t sim_TMR1;  volatile uint8_t sim_TMR1H;
+
+sim_t *sim;
+
+// --- PINES ---
+
+// Entradas que maneja la planta: V_BAT, AHORRO y estado del FF
+static void actualizar_pines(void) {
+    uint8_t falla_ant = PORTBbits.RB0;
+
+    // Reset del FF (RB1) mientras no persista la condición de disparo
+    if (PORTBbits.RB1 && !sim->falla_pendiente)
+        sim->ff = 0;
+
+    PORTAbits.RA4 = (sim->planta.vbus > sim->vbat_min);
+    PORTCbits.RC6 = (uint8_t)sim->ahorro;
+    PORTBbits.RB0 = !sim->ff;
+    if (TRISBbits.TRISB7)
+        PORTBbits.RB7 = sim->sync_entrada;
+
+    // Flanco descendente en INT0
+    if (falla_ant && !PORTBbits.RB0 && INTCON2bits.INTEDG0 == 0)
+        INTCONbits.INT0IF = 1;
+    if (!falla_ant && PORTBbits.RB0 && INTCON2bits.INTEDG0 == 1)
+        INTCONbits.INT0IF = 1;
+}
+
+// --- INTERRUPCIONES ---
+
+static int interrupcion_pendiente(void) {
+    if (INTCONbits.INT0IE && INTCONbits.INT0IF)
+        return 1;
+    if (INTCONbits.PEIE && PIE1bits.TMR2IE && PIR1bits.TMR2IF)
+        return 1;
+    if (INTCONbits.PEIE && PIE2bits.EEIE && PIR2bits.EEIF)
+        return 1;
+    return 0;
+}
+
+static void convertir(void);
+
+static void atender_interrupciones(void) {
+    int int0;
+    int go;
+
+    if (sim->en_isr || !INTCONbits.GIE || !interrupcion_pendiente())
+        return;
+
+    int0 = INTCONbits.INT0IE && INTCONbits.INT0IF;
+    go = sim_ADCON0.GO;
+    sim->en_isr = 1;
+    INTCONbits.GIE = 0;         // El hardware borra GIE al vectorizar
+#if MEDIR_ISR
+    if (PIE1bits.TMR2IE && PIR1bits.TMR2IF && !int0)
+    {
+        struct timespec a, b;
+
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        isr();
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        sim->isr_ns += (double)(b.tv_sec - a.tv_sec) * 1e9 + (double)(b.tv_nsec - a.tv_nsec);
+        sim->isr_n++;
+    }
+    else
+#endif
+    isr();
+    INTCONbits.GIE = 1;         // RETFIE
+    sim->en_isr = 0;
+
+    // Conversión arrancada por la ISR (AD_SINCRONO): el A/D la termina en ~12 us
+    // mientras la CPU sigue; se toma la planta a la salida de la ISR
+    if (!go && sim_ADCON0.GO && sim_ADCON0.ADON)
+        convertir();
+
+    // Latencia de la falla: hasta que la ISR deshabilitó los módulos PWM
+    if (int0 && sim->latencia_falla_us < 0.0 && sim->t_falla_real >= 0.0 &&
+        (CCP1CON & 0x0F) == 0 && (CCP2CON & 0x0F) == 0)
+    {
+        sim->latencia_falla_us = sim->t_evento_us + SIM_T_ENTRADA_ISR_US
+                               - sim->t_falla_real * 1e6;
+    }
+}
+
+// --- PLANTA ---
+
+static double duty(uint8_t ccprl, uint8_t dcb, uint8_t modo) {
+    if ((modo & 0x0C) != 0x0C)
+        return 0.0;
+    return (double)(((uint16_t)ccprl << 2) | dcb) / (4.0 * ((double)PR2 + 1.0));
+}
+
+// Integra la planta un intervalo; con el PWM detenido el puente queda sin excitación
+static void integrar(double us, int pwm) {
+    planta_t *p = &sim->planta;
+    double dt = us * 1e-6 / sim->subpasos;
+    double d = 0.0;
+    int habilitado, i;
+    double a_v, a_i, k;
+
+    if (pwm)
+    {
+        double d1 = (CCP1CON & 0x0F) ? sim->d1 : 0.0;
+        double d2 = (CCP2CON & 0x0F) ? sim->d2 : 0.0;
+
+        d = d1 - d2;
+        p->ramas = (d1 > 0.0 && d1 < 1.0) + (d2 > 0.0 && d2 < 1.0);
+    }
+    habilitado = pwm && !sim->ff && !PORTCbits.RC0;
+
+    for (i = 0; i < sim->subpasos; i++)
+    {
+        planta_paso(p, d, habilitado, dt);
+
+        if (sim->i_disparo_hw > 0.0 && fabs(p->il) > sim->i_disparo_hw)
+            sim->ff = 1;
+
+        // Detectores de pico de AN0/AN1
+        a_v = fabs(p->vc) * sim->k_v;
+        a_i = fabs(p->io) * sim->k_i;
+        k = dt / sim->tau_env;
+        sim->env_v = (a_v > sim->env_v) ? a_v : sim->env_v - sim->env_v * k;
+        sim->env_i = (a_i > sim->env_i) ? a_i : sim->env_i - sim->env_i * k;
+
+        sim->suma_v2 += p->vc * p->vc;
+        sim->suma_i2 += p->io * p->io;
+        sim->muestras++;
+    }
+
+    // Disipador y trafo: primer orden hacia ambiente + k * I^2 del último ciclo
+    k = (us * 1e-6) / sim->tau_termico;
+    a_i = sim->k_termico * sim->irms * sim->irms;
+    sim->temp_disip += (sim->an_t_disip + a_i - sim->temp_disip) * k;
+    sim->temp_trafo += (sim->an_t_trafo + a_i - sim->temp_trafo) * k;
+
+    // RC de la prueba de carga: RC7 = 1 lo mantiene descargado
+    if (PORTCbits.RC7)
+        sim->rc = 0.0;
+    else
+        sim->rc += (255.0 - sim->rc) * (us * 1e-6) / sim->tau_rc;
+}
+
+// Cierre de ciclo de 50 Hz: dos vueltas de tabla
+static void estadisticas_ciclo(void) {
+    if (!(CICLO_0 == 0 && sim->ciclo_ant == 97))
+    {
+        sim->ciclo_ant = CICLO_0;
+        return;
+    }
+    sim->ciclo_ant = CICLO_0;
+    if (++sim->semiciclos < 2)
+        return;
+    sim->semiciclos = 0;
+
+    if (sim->muestras)
+    {
+        sim->vrms = sqrt(sim->suma_v2 / sim->muestras);
+        sim->irms = sqrt(sim->suma_i2 / sim->muestras);
+    }
+    sim->suma_v2 = 0.0;
+    sim->suma_i2 = 0.0;
+    sim->muestras = 0;
+    if (sim->ciclos < SIM_MAX_CICLOS)
+    {
+        sim->vrms_ciclo[sim->ciclos] = (float)sim->vrms;
+        sim->t_ciclo[sim->ciclos] = (float)sim->planta.t;
+    }
+    sim->ciclos++;
+
+    memcpy(sim->v_ultimo, sim->v_muestras, sim->n_muestras * sizeof(float));
+    sim->n_ultimo = sim->n_muestras;
+    sim->n_muestras = 0;
+
+    if (sim->traza)
+    {
+        fprintf(sim->traza, "%.4f,%.1f,%.2f,%u,%u,%u,%u,%u,%.2f\n",
+                sim->planta.t, sim->vrms, sim->irms,
+                ((unsigned)V_PICO_0 << 8) | V_PICO_1, V_SALIDA, I_SALIDA,
+                ESTADO, PREVIO, sim->planta.vbus);
+    }
+}
+
+// Ajustes de parámetros del firmware: se aplican en el primer evento de hardware,
+// cuando inicializar_variables() ya corrió
+static void configurar_firmware(void) {
+    if (sim->configurado)
+        return;
+    sim->configurado = 1;
+    if (sim->fw_kp >= 0) kp = kp_nom = (uint8_t)sim->fw_kp;
+    if (sim->fw_ki >= 0) ki = ki_nom = (uint8_t)sim->fw_ki;
+    if (sim->fw_kd >= 0) kd = kd_nom = (uint8_t)sim->fw_kd;
+    if (sim->fw_ref >= 0) { REF0 = (uint8_t)(sim->fw_ref >> 8); REF1 = (uint8_t)sim->fw_ref; }
+    if (sim->fw_i_max >= 0) I_MAX = (uint8_t)sim->fw_i_max;
+    if (sim->fw_pp_max >= 0) PP_MAX = (uint8_t)sim->fw_pp_max;
+    if (sim->fw_aa >= 0) AA = (uint8_t)sim->fw_aa;
+    if (sim->fw_u >= 0)         // El divisor U_0:U_1 acompaña a U (100 -> 8000)
+    {
+        U = (uint8_t)sim->fw_u;
+        U_0 = (uint8_t)((sim->fw_u * 80) >> 8);
+        U_1 = (uint8_t)(sim->fw_u * 80);
+    }
+    if (sim->fw_his_dis1 >= 0) HIS_DIS1 = (uint8_t)sim->fw_his_dis1;
+    if (sim->fw_his_dis2 >= 0) HIS_DIS2 = (uint8_t)sim->fw_his_dis2;
+    if (sim->fw_his_tra1 >= 0) HIS_TRA1 = (uint8_t)sim->fw_his_tra1;
+    if (sim->fw_his_tra2 >= 0) HIS_TRA2 = (uint8_t)sim->fw_his_tra2;
+    if (sim->guardar_par)
+        guardar_parametros();
+}
+
+// --- EEPROM ---
+
+// WR en 1: toma dirección y dato y termina SIM_EE_TICKS después con EEIF. La
+// escritura sigue en SLEEP, como en el micro.
+static void eeprom_tick(void) {
+    if (sim->ee_ticks == 0 && EECON1bits.WR)
+    {
+        if (!EECON1bits.WREN || EECON1bits.EEPGD || EECON1bits.CFGS)
+        {
+            EECON1bits.WR = 0;
+            EECON1bits.WRERR = 1;
+            return;
+        }
+        sim->ee_dir = EEADR;
+        sim->ee_dato = sim_EEDATA;
+        sim->ee_ticks = SIM_EE_TICKS;
+        return;
+    }
+    if (sim->ee_ticks > 0 && --sim->ee_ticks == 0)
+    {
+        sim->eeprom[sim->ee_dir] = sim->ee_dato;
+        sim->ee_escrituras++;
+        EECON1bits.WR = 0;
+        PIR2bits.EEIF = 1;
+    }
+}
+
+volatile uint8_t *sim_eedata(void) {
+    if (EECON1bits.RD)
+    {
+        sim_EEDATA = sim->eeprom[EEADR];
+        EECON1bits.RD = 0;
+    }
+    return &sim_EEDATA;
+}
+
+// Timer1 con reloj interno: el contador del tick más los Tcy ya consumidos en él
+volatile uint8_t *sim_tmr1l(void) {
+    static volatile uint8_t l;
+    uint16_t t = sim_TMR1.cuenta;
+
+    if (T1CONbits.TMR1ON)
+        t += (uint16_t)(sim->resto_us * SIM_FOSC / 4e6) >> T1CONbits.T1CKPS;
+    l = (uint8_t)t;
+    sim_TMR1H = (uint8_t)(t >> 8);
+    return &l;
+}
+
+// Byte que el display devuelve por SDI: los comandos programados, en orden, cada
+// uno desde su instante; si no, 0x00. Con RC4 de salida se lee el propio LATC4.
+static uint8_t sdi_display(void) {
+    const uint8_t *c;
+    uint8_t d;
+
+    if (TRISCbits.TRISC4 == 0)
+        return LATCbits.LATC4 ? 0xFF : 0x00;
+    if (sim->cmd_sig >= sim->n_cmd || sim->ticks * SIM_T_TICK_US * 1e-6 < sim->cmd_t[sim->cmd_sig])
+        return 0x00;
+
+    c = sim->cmd[sim->cmd_sig];
+    switch (sim->cmd_byte)
+    {
+    case 0: d = CMD_SINCRO; break;
+    case 4: d = (uint8_t)~(c[0] + c[1] + c[2]); break;
+    default: d = c[sim->cmd_byte - 1]; break;
+    }
+    if (++sim->cmd_byte == 5)
+    {
+        sim->cmd_byte = 0;
+        sim->cmd_sig++;
+    }
+    return d;
+}
+
+// SSPBUF: con el MSSP habilitado, un acceso con SSPIF en 0 es el comienzo de un
+// byte (enviar() limpia SSPIF antes de cada uno). Con SSPIF en 1 es la lectura de
+// lo recibido.
+volatile uint8_t *sim_sspbuf(void) {
+    static const uint8_t divisor[4] = { 4, 16, 64, 4 };
+
+    if (PIR1bits.SSPIF)
+        return &sim->spi_rx;
+    if (SSPCON1bits.SSPEN)
+    {
+        sim->spi_bytes++;
+        sim_avanzar_us(8.0 * divisor[SSPCON1bits.SSPM & 3] * 1e6 / SIM_FOSC);
+        sim->spi_rx = sdi_display();
+        PIR1bits.SSPIF = 1;
+    }
+    return &sim_SSPBUF;
+}
+
+// Un período completo de Timer2. pwm = 0 en SLEEP (oscilador detenido).
+static void tick(int pwm) {
+    double t0, t_tick;
+    int corre = pwm && T2CONbits.TMR2ON;
+
+    if (sim->ticks >= sim->ticks_reset)
+        configurar_firmware();
+
+    // Falla inyectada dentro de este tick: integra hasta el instante exacto
+    t0 = (double)sim->ticks * SIM_T_TICK_US;
+    t_tick = SIM_T_TICK_US;
+    if (sim->t_falla >= 0.0 && sim->t_falla_real < 0.0 && sim->t_falla * 1e6 < t0 + SIM_T_TICK_US)
+    {
+        double parcial = sim->t_falla * 1e6 - t0;
+        if (parcial < 0.0)
+            parcial = 0.0;
+        integrar(parcial, corre);
+        t_tick -= parcial;
+        sim->t_falla_real = sim->t_falla;
+        sim->falla_pendiente = 1;
+        sim->ff = 1;
+        sim->t_evento_us = t0 + parcial;
+        actualizar_pines();
+        if (pwm)
+            atender_interrupciones();
+    }
+    integrar(t_tick, corre && T2CONbits.TMR2ON);
+
+    sim->ticks++;
+    if (sim->sincronizar)
+    {
+        sim->sync_salida = LATBbits.LATB7;
+        sim->sincronizar(sim);      // Bus común y línea de sincronismo
+    }
+    sim->t_evento_us = (double)sim->ticks * SIM_T_TICK_US;
+    if (sim->n_muestras < SIM_MAX_MUESTRAS)
+        sim->v_muestras[sim->n_muestras++] = (float)sim->planta.vc;
+    if (sim->falla_pendiente && sim->t_falla_real >= 0.0)
+        sim->falla_pendiente = 0;       // La falla es un pulso: el FF la retiene
+
+    // Fin de período: latch del duty e interrupción de Timer2
+    if (corre)
+    {
+        sim->d1 = duty(CCPR1L, (uint8_t)CCP1CONbits.DC1B, CCP1CON);
+        sim->d2 = duty(CCPR2L, (uint8_t)CCP2CONbits.DC2B, CCP2CON);
+        PIR1bits.TMR2IF = 1;
+    }
+
+    eeprom_tick();
+
+    // Timer0: 256 Tcy por tick
+    if (pwm && T0CONbits.TMR0ON)
+        sim_TMR0.cuenta += T0CONbits.PSA ? 256 : (256 >> (T0CONbits.T0PS + 1));
+    if (pwm && T1CONbits.TMR1ON)
+        sim_TMR1.cuenta += 256 >> T1CONbits.T1CKPS;
+
+    actualizar_pines();
+    if (pwm)
+    {
+        atender_interrupciones();
+        estadisticas_ciclo();
+    }
+
+    // Disparos: cada entrada a apagar(), que enciende el buzzer (RB5)
+    if (LATBbits.LATB5 && !sim->buzzer_ant)
+    {
+        if (!sim->disparos)
+            sim->t_disparo = sim->ticks * SIM_T_TICK_US * 1e-6;
+        sim->disparos++;
+    }
+    sim->buzzer_ant = LATBbits.LATB5;
+
+    // Fin del tiempo de simulación
+    if (sim->ticks >= sim->ticks_fin)
+        longjmp(sim->salida, 1);
+}
+
+// --- INTRÍNSECOS DEL FIRMWARE ---
+
+// Tiempo de CPU consumido por el firmware (conversiones, demoras)
+void sim_avanzar_us(double us) {
+    configurar_firmware();
+    sim->resto_us += us;
+    while (sim->resto_us >= SIM_T_TICK_US && !sim->en_isr)
+    {
+        sim->resto_us -= SIM_T_TICK_US;
+        tick(1);
+    }
+}
+
+// Antes de main(): el micro en reset, con el puente apagado y la planta corriendo
+void sim_esperar_reset(void) {
+    while (sim->ticks < sim->ticks_reset)
+        tick(0);
+}
+
+// ESPERA_TICK(): el firmware espera un evento del hardware
+void sim_tick(void) {
+    tick(1);
+}
+
+void sim_demora_us(uint16_t us) {
+    sim_avanzar_us((double)us);
+}
+
+// Resultado de la conversión del canal elegido, con la planta en este instante
+static void convertir(void) {
+    double v = 0.0;
+
+    switch (sim_ADCON0.CHS)
+    {
+    case 0: v = sim->sensado_inst ? fabs(sim->planta.vc) * sim->k_v : sim->env_v; break;
+    case 1: v = sim->env_i; break;
+    case 2: v = sim->temp_disip; break;
+    case 3: v = sim->an_ref; break;
+    case 4: v = sim->temp_trafo; break;
+    case 8: v = sim->an_i_minima; break;
+    case 9: v = sim->rc; break;
+    default: v = 0.0; break;
+    }
+#ifdef CANAL_VBAT
+    if (sim_ADCON0.CHS == CANAL_VBAT)
+        v = sim->planta.vbus * sim->k_vbat;
+#endif
+    if (v > 255.0)
+        v = 255.0;
+    // 10 bits justificados a la izquierda; ADRESH redondea como siempre
+    {
+        uint16_t v10 = (uint16_t)(4.0 * (v + 0.5));
+        if (v10 > 1023)
+            v10 = 1023;
+        ADRESH = (uint8_t)(v10 >> 2);
+        ADRESL = (uint8_t)((v10 & 0x03) << 6);
+    }
+    sim_ADCON0.GO = 0;
+}
+
+// ADCON0bits: al consultar GO con una conversión en curso se completa
+volatile ADCON0_t *sim_adcon0(void) {
+    if (sim_ADCON0.GO && sim_ADCON0.ADON)
+    {
+        sim_avanzar_us(SIM_T_ADC_US);
+        if (sim->t_atasco >= 0.0 && !sim->atasco_hecho && !sim->en_isr &&
+            sim->ticks * SIM_T_TICK_US * 1e-6 >= sim->t_atasco)
+        {
+            sim->atasco_hecho = 1;
+            sim_avanzar_us(sim->atasco * 1e6);
+        }
+        convertir();
+    }
+    return &sim_ADCON0;
+}
+
+// SLEEP(): IDLE (IDLEN = 1) mantiene Timer2/Timer0; sueño profundo solo el WDT
+void sim_sleep(void) {
+    uint32_t wdt = (uint32_t)(SIM_WDT_NOM_TICKS * sim->wdt_factor);
+    uint32_t n;
+    int idle = OSCCONbits.IDLEN;
+    int gie = INTCONbits.GIE;
+
+    for (n = 0; ; n++)
+    {
+        // Despertar por interrupción habilitada (con o sin GIE)
+        if (interrupcion_pendiente())
+            break;
+        if (WDTCONbits.SWDTEN && n >= wdt)
+        {
+            RCONbits.TO = 0;
+            break;
+        }
+        INTCONbits.GIE = 0;     // Sin vectorizar mientras duerme
+        tick(idle);
+        INTCONbits.GIE = gie;
+    }
+    atender_interrupciones();
+}
+
+// Estado inicial del hardware antes de correr main_firmware()
+void sim_arrancar(void) {
+    sim->ticks = 0;
+    sim->resto_us = 0.0;
+    sim->en_isr = 0;
+    sim->configurado = 0;
+    sim->ff = 0;
+    sim->falla_pendiente = 0;
+    sim->t_falla_real = -1.0;
+    sim->latencia_falla_us = -1.0;
+    sim->isr_ns = 0.0;
+    sim->isr_n = 0;
+    sim->d1 = 0.0;
+    sim->d2 = 0.0;
+    sim->env_v = 0.0;
+    sim->env_i = 0.0;
+    sim->rc = 0.0;
+    sim->ciclo_ant = 0;
+    sim->semiciclos = 0;
+    sim->suma_v2 = 0.0;
+    sim->suma_i2 = 0.0;
+    sim->muestras = 0;
+    sim->vrms = 0.0;
+    sim->irms = 0.0;
+    sim->ciclos = 0;
+    sim->disparos = 0;
+    sim->buzzer_ant = 0;
+    sim->ee_ticks = 0;
+    sim->ee_escrituras = 0;
+    sim->spi_bytes = 0;
+    sim->cmd_sig = 0;
+    sim->cmd_byte = 0;
+    sim->n_muestras = 0;
+    sim->n_ultimo = 0;
+    sim->temp_disip = sim->an_t_disip;
+    sim->temp_trafo = sim->an_t_trafo;
+    sim->planta.vbus = sim->planta.vbat;
+    PORTBbits.RB0 = 1;
+    actualizar_pines();
+}
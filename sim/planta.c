@@ -0,0 +1,138 @@
+/**
+ * @file planta.c
+ * @brief Integración del modelo del inversor (Euler semi-implícito).
+ */
+
+#include <math.h>
+#include "planta.h"
+
+// Valores por defecto: 24 V, 1 kW, 230 V 50 Hz
+void planta_defecto(planta_t *p) {
+    p->vbat = 24.0;
+    p->rbat = 0.02;
+    p->vbat_escalon = 0.0;
+    p->t_vbat = 0.0;
+    p->n = 20.5;            // V_PICO = 676 (66 % de duty) -> ~325 V pico
+
+    p->lf = 3e-3;
+    p->rl = 0.5;
+    p->cf = 10e-6;
+
+    p->tm = 0.0;
+    p->t_pwm = 51.2e-6;
+    p->ramas = 0;
+
+    p->tipo = CARGA_R;
+    p->r = 53.0;            // 1 kW a 230 V
+    p->l = 50e-3;
+    p->c_rect = 470e-6;
+    p->r_s = 1.0;
+    p->r_arranque = 8.0;
+    p->tau_motor = 0.3;
+    p->t_carga = 0.0;
+    p->t_descarga = 0.0;
+    p->t_recarga = 0.0;
+    p->unidades = 1;
+    p->i_otros = 0.0;
+
+    p->il = 0.0;
+    p->vc = 0.0;
+    p->io = 0.0;
+    p->icarga = 0.0;
+    p->vrect = 0.0;
+    p->vbus = p->vbat;
+    p->ibus = 0.0;
+    p->t = 0.0;
+}
+
+// Corriente que toma la carga con tensión de salida vc; integra su estado interno
+static double carga_paso(planta_t *p, double dt) {
+    double r, id, v;
+    int conectada = planta_conectada(p);
+
+    // Bus común: la corriente de salida es il menos la parte de esta unidad en la
+    // carga del capacitor total, así vc sube con (il total - v / r) / (N cf)
+    if (p->tipo == CARGA_BUS)
+    {
+        id = conectada ? p->vc / p->r : 0.0;
+        return p->il - (p->il + p->i_otros - id) / p->unidades;
+    }
+    if (!conectada)
+        return 0.0;
+
+    switch (p->tipo)
+    {
+    case CARGA_R:
+        return p->vc / p->r;
+
+    case CARGA_RL:
+        p->icarga += dt / p->l * (p->vc - p->r * p->icarga);
+        return p->icarga;
+
+    case CARGA_MOTOR:
+        // Rotor bloqueado al conectar: R sube hacia la de marcha al acelerar
+        v = (p->t_recarga > p->t_descarga && p->t >= p->t_recarga) ? p->t_recarga : p->t_carga;
+        r = p->r - (p->r - p->r_arranque) * exp(-(p->t - v) / p->tau_motor);
+        p->icarga += dt / p->l * (p->vc - r * p->icarga);
+        return p->icarga;
+
+    case CARGA_RECT:
+        v = fabs(p->vc);
+        id = (v > p->vrect) ? (v - p->vrect) / p->r_s : 0.0;
+        p->vrect += dt / p->c_rect * (id - p->vrect / p->r);
+        return (p->vc >= 0.0) ? id : -id;
+
+    default:
+        return 0.0;
+    }
+}
+
+// Volt-segundos perdidos por el tiempo muerto, como fracción del período.
+// Fuera de la banda del rizado la corriente no cambia de signo dentro del
+// período y cada rama pierde tm / T; dentro, la rama conmuta en parte con la
+// corriente a favor y la pérdida baja en proporción.
+static double perdida_tm(const planta_t *p, double d) {
+    double m = fabs(d), rizado, x;
+
+    if (p->tm <= 0.0 || p->ramas == 0)
+        return 0.0;
+    rizado = p->n * p->vbus * m * (1.0 - m) * p->t_pwm / (2.0 * p->lf);
+    if (rizado < 0.05)
+        rizado = 0.05;
+    x = p->il / rizado;
+    if (x > 1.0) x = 1.0;
+    if (x < -1.0) x = -1.0;
+    return p->ramas * p->tm / p->t_pwm * x;
+}
+
+// Un subpaso de integración. d = duty CCP1 - duty CCP2 (-1..1).
+// Con el puente deshabilitado (FF disparado o PWM detenido) la corriente del
+// inductor descarga por los diodos contra el bus hasta anularse.
+void planta_paso(planta_t *p, double d, int habilitado, double dt) {
+    double v_sec, il_ant;
+
+    p->vbus = p->vbat - p->rbat * p->ibus;
+    if (p->vbat_escalon != 0.0 && p->t >= p->t_vbat)
+        p->vbus += p->vbat_escalon;
+
+    if (habilitado)
+    {
+        d -= perdida_tm(p, d);
+        v_sec = p->n * p->vbus * d;
+        p->il += dt / p->lf * (v_sec - p->rl * p->il - p->vc);
+        p->ibus = p->n * p->il * d;
+    }
+    else
+    {
+        il_ant = p->il;
+        v_sec = (il_ant > 0.0) ? -p->n * p->vbus : p->n * p->vbus;
+        p->il += dt / p->lf * (v_sec - p->rl * p->il - p->vc);
+        if (il_ant == 0.0 || (il_ant > 0.0) != (p->il > 0.0))
+            p->il = 0.0;
+        p->ibus = 0.0;
+    }
+
+    p->io = carga_paso(p, dt);
+    p->vc += dt / p->cf * (p->il - p->io);
+    p->t += dt;
+}
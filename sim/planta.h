@@ -0,0 +1,81 @@
+/**
+ * @file planta.h
+ * @brief Modelo en tiempo discreto del inversor: batería, puente H, transformador,
+ * filtro LC de salida y cargas.
+ * Modelo promediado por período PWM, referido al secundario del transformador.
+ */
+
+#ifndef PLANTA_H
+#define PLANTA_H
+
+// --- TIPOS DE CARGA ---
+typedef enum {
+    CARGA_NINGUNA = 0,
+    CARGA_R,            // Resistiva
+    CARGA_RL,           // Inductiva (R serie L)
+    CARGA_RECT,         // Rectificador de onda completa + capacitor + R
+    CARGA_MOTOR,        // R serie L con R creciente desde el arranque (inrush)
+    CARGA_BUS           // Capacitor compartido con otras unidades y R común (paralelo.c)
+} tipo_carga_t;
+
+typedef struct {
+    // Batería y puente
+    double vbat;            // Tensión de batería en vacío [V]
+    double rbat;            // Resistencia interna de la batería [ohm]
+    double vbat_escalon;    // Cambio de la tensión en vacío en t_vbat (otra carga en la batería) [V]
+    double t_vbat;          // [s]
+    double n;               // Relación del transformador (secundario / primario)
+
+    // Filtro LC (dispersión del trafo incluida en lf)
+    double lf;              // [H]
+    double rl;              // Resistencia serie del inductor [ohm]
+    double cf;              // [F]
+
+    // Tiempo muerto del puente (IR2110 + FF): en cada conmutación de una rama
+    // la tensión la fija el diodo que conduce, según el signo de la corriente
+    double tm;              // Tiempo muerto por rama [s] (0 = ideal)
+    double t_pwm;           // Período PWM [s]
+    int ramas;              // Ramas que conmutan en este período (0..2)
+
+    // Carga
+    tipo_carga_t tipo;
+    double r;               // R de la carga (en marcha, para el motor) [ohm]
+    double l;               // L de la carga RL / motor [H]
+    double c_rect;          // Capacitor del rectificador [F]
+    double r_s;             // Resistencia serie de los diodos [ohm]
+    double r_arranque;      // R del motor bloqueado [ohm]
+    double tau_motor;       // Constante de aceleración del motor [s]
+    double t_carga;         // Instante de conexión de la carga [s]
+    double t_descarga;      // Instante de desconexión (<= t_carga = nunca) [s]
+    double t_recarga;       // Instante de reconexión (<= t_descarga = nunca) [s]
+
+    // CARGA_BUS: vc es el bus común. Los capacitores de las unidades quedan en
+    // paralelo y cada una aporta su il; r es la carga común (t_carga y t_descarga)
+    int unidades;
+    double i_otros;         // Suma de il de las demás unidades (la fija paralelo.c) [A]
+
+    // Estado
+    double il;              // Corriente del inductor del filtro [A]
+    double vc;              // Tensión de salida [V]
+    double io;              // Corriente de salida hacia la carga [A]
+    double icarga;          // Corriente de la carga RL / motor [A]
+    double vrect;           // Tensión del capacitor del rectificador [V]
+    double vbus;            // Tensión en bornes de la batería [V]
+    double ibus;            // Corriente media de batería [A]
+    double t;               // Tiempo simulado [s]
+} planta_t;
+
+void planta_defecto(planta_t *p);
+void planta_paso(planta_t *p, double d, int habilitado, double dt);
+
+// Carga conectada en t: desde t_carga hasta t_descarga y otra vez desde t_recarga.
+// En el encabezado porque paralelo.c no enlaza planta.c (la trae cada biblioteca)
+static inline int planta_conectada(const planta_t *p) {
+    if (p->t < p->t_carga)
+        return 0;
+    if (p->t_descarga > p->t_carga && p->t >= p->t_descarga)
+        return p->t_recarga > p->t_descarga && p->t >= p->t_recarga;
+    return 1;
+}
+
+#endif // PLANTA_H
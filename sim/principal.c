@@ -0,0 +1,206 @@
+/**
+ * @file principal.c
+ * @brief Línea de comandos del simulador: una corrida con los parámetros dados.
+ *
+ * Compilación: sim/compilar.sh  (genera ./inversor_sim)
+ * Uso: ./inversor_sim [clave=valor ...] [traza=<archivo.csv>] [eeprom=<archivo.bin>]
+ * eeprom: contenido de la EEPROM de datos (256 bytes), leído antes de arrancar si
+ * existe y guardado al terminar; se decodifica con ./inversor_registro.
+ * Claves: ver simulador.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/global_vars.h"
+#include "simulador.h"
+
+static double reloj_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    static sim_t s;
+    sim_metricas_t m;
+    double t0, t_pared, t_sim, pasos;
+    const char *eeprom = NULL;
+    int i;
+
+    sim_defecto(&s);
+    for (i = 1; i < argc; i++)
+    {
+        char clave[32];
+        const char *igual = strchr(argv[i], '=');
+        size_t n = igual ? (size_t)(igual - argv[i]) : 0;
+
+        if (igual && !strncmp(argv[i], "traza", n) && n == 5)
+        {
+            s.traza = fopen(igual + 1, "w");
+            if (s.traza)
+                fprintf(s.traza, "t,vrms,irms,v_pico,v_salida,i_salida,estado,previo,vbus\n");
+            continue;
+        }
+        if (igual && !strncmp(argv[i], "eeprom", n) && n == 6)
+        {
+            FILE *f = fopen(igual + 1, "rb");
+
+            eeprom = igual + 1;
+            if (f)
+            {
+                if (fread(s.eeprom, 1, sizeof(s.eeprom), f) != sizeof(s.eeprom))
+                    fprintf(stderr, "%s: EEPROM incompleta, el resto queda borrado\n", eeprom);
+                fclose(f);
+            }
+            continue;
+        }
+        if (!igual || n >= sizeof(clave))
+        {
+            fprintf(stderr, "parámetro inválido: %s\n", argv[i]);
+            return 1;
+        }
+        memcpy(clave, argv[i], n);
+        clave[n] = '\0';
+        if (!sim_parametro(&s, clave, igual + 1))
+        {
+            fprintf(stderr, "parámetro desconocido: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    t0 = reloj_s();
+    sim_correr(&s);
+    t_pared = reloj_s() - t0;
+    sim_metricas(&s, &m);
+
+    t_sim = s.ticks * SIM_T_TICK_US * 1e-6;
+    pasos = (double)s.ticks * s.subpasos;
+    printf("Simulado: %.3f s (%u ticks, %.0f pasos) en %.1f ms\n",
+           t_sim, s.ticks, pasos, t_pared * 1e3);
+    printf("Velocidad: %.2e ticks/s, %.2e pasos/s, %.0fx tiempo real\n",
+           s.ticks / t_pared, pasos / t_pared, t_sim / t_pared);
+    printf("Salida: %.1f Vrms  %.2f Arms  Vbus %.2f V  (%u ciclos)\n",
+           s.vrms, s.irms, s.planta.vbus, s.ciclos);
+    printf("Firmware: V_PICO=%u V_SALIDA=%u I_SALIDA=%u REF_ERR=%u ESTADO=0x%02X PREVIO=0x%02X\n",
+           ((unsigned)V_PICO_0 << 8) | V_PICO_1, V_SALIDA, I_SALIDA, REF_ERR, ESTADO, PREVIO);
+    printf("Ganancias: kp=%u ki=%u kd=%u  Disparos: %u  F_SUENO: %u/255\n",
+           kp, ki, kd, s.disparos, F_SUENO);
+    printf("Establecimiento: %.3f s  Sobrepico: %.1f %%  THD: %.2f %%\n",
+           m.t_establecimiento, m.sobrepico, m.thd);
+#if THD_GOERTZEL
+    printf("THD estimada por el firmware: %.1f %%\n", THD_X10 / 10.0);
+#endif
+    {
+        static const char *fases[ARR_FASES] = {
+            "periféricos", "variables", "FF", "REF", "prueba", "potencia"
+        };
+        printf("Arranque [ms]:");
+        for (i = 0; i < ARR_FASES; i++)
+        {
+            if (ARR_MARCAS & (1 << i))
+                printf(" %s %.1f", fases[i], T_ARRANQUE[i] * 0.0512);
+            else
+                printf(" %s -", fases[i]);
+        }
+        printf("\n");
+    }
+#if TRAZA_MODO == TRAZA_SPI
+    {
+        static const char *puntos[] = {
+            "?", "isr", "isr_fin", "ciclo", "pid", "pid_fin", "i_salida", "i_salida_fin",
+            "temperat", "temperat_fin", "enviar", "enviar_fin", "encender", "apagar",
+            "apagar_1", "prueba", "out_fija"
+        };
+        uint8_t j = (uint8_t)((TRAZA_ENTRA - TRAZA_N) & (TRAZA_REGISTROS - 1));
+
+        // Tiempo dentro del ciclo de 50 Hz: índice x 2 ticks + NN - 1, más TMR2
+        printf("Traza (%u registros, %u pisados):\n", TRAZA_N, TRAZA_PERDIDOS);
+        for (i = 0; i < TRAZA_N; i++, j = (j + 1) & (TRAZA_REGISTROS - 1))
+        {
+            uint8_t id = TRAZA_BUF[j][0] & 0x7F;
+            double us = ((TRAZA_BUF[j][1] * 2 + (TRAZA_BUF[j][0] >> 7)) * 256 + TRAZA_BUF[j][2]) * 0.2;
+
+            printf("  %-13s %8.1f us\n", id <= TP_OUT_FIJA ? puntos[id] : "?", us);
+        }
+    }
+#endif
+#if RESUMEN
+    if (RES_NUMERO)
+    {
+        static const char *variables[RES_VARIABLES] = { "V_SALIDA", "I_SALIDA", "T_DISIP", "T_TRAFO" };
+        const volatile uint8_t *r = RES_TRAMA + 1;
+
+        printf("Resumen %u (%u ciclos, %u bytes):", RES_TRAMA[0], 1u << RESUMEN_LOG2, RESUMEN_BYTES);
+        for (i = 0; i < RES_VARIABLES; i++, r += 3)
+            printf(" %s %u/%u/%u", variables[i], r[0], r[1], r[2]);
+        printf("\n  I_SALIDA por cubeta:");
+        for (i = 0; i < RES_CUBETAS; i++, r += 2)
+            printf(" %u", (r[0] << 8) | r[1]);
+        printf("\n  Sobre umbral: disipador %u trafo %u ciclos  Entradas a ESTADO<0..7>:",
+               (r[0] << 8) | r[1], (r[2] << 8) | r[3]);
+        for (i = 0, r += 4; i < 8; i++)
+            printf(" %u", *r++);
+        printf("  F_SUENO %u THD_X10 %u\n", r[0], r[1]);
+    }
+#endif
+    printf("SPI: %u bytes\n", s.spi_bytes);
+#if COMANDOS_SPI
+    printf("Comandos: %u aplicados, %u con error  REF_ERR=%u (%s)\n", CMD_APLICADOS, CMD_ERRORES,
+           REF_ERR, REF_REMOTA ? "remota" : "AN3");
+#endif
+#if MEDIR_TAREAS
+    {
+        static const char *tareas[TAREAS] = {
+            "v_pico", "ad_v", "pid", "i_salida", "ajustes", "temperat",
+            "bateria", "ahorro", "ocupado", "holgura"
+        };
+        int b;
+
+        // Cuentas de Timer1 (1,6 us); cubetas de 6,4 us x 2^(b-1) a 2^b
+        printf("Tareas [us, desde su última trama]   mín      máx     histograma (<6.4, <12.8, <25.6, ... , >=6554)\n");
+        for (i = 0; i < TAREAS; i++)
+        {
+            if (HIST_MAX[i] == 0 && HIST_MIN[i] == 0xFFFF)
+                continue;
+            printf("  %-9s %7.1f %8.1f  ", tareas[i], HIST_MIN[i] * 1.6, HIST_MAX[i] * 1.6);
+            for (b = 0; b < HIST_CUBETAS; b++)
+                printf(" %u", HIST_CUENTAS[i][b]);
+            printf("\n");
+        }
+        printf("Ciclos sin holgura (desde la última trama): %u\n", HOLGURA_CERO);
+    }
+#endif
+#if MEDIR_ISR
+    // En el PIC la peor duración llega en la trama (ISR_TCY); acá TMR2 no avanza
+    // dentro de la ISR y solo se puede comparar el costo relativo en el host
+    if (s.isr_n)
+        printf("ISR de Timer2 en el host: %.1f ns de media (%u llamadas)\n", s.isr_ns / s.isr_n, s.isr_n);
+#endif
+    if (s.disparos)
+        printf("Primer disparo: %.3f s\n", s.t_disparo);
+    if (s.t_falla >= 0.0)
+    {
+        if (s.latencia_falla_us >= 0.0)
+            printf("Falla en %.6f s: PWM cortado en %.1f us\n", s.t_falla, s.latencia_falla_us);
+        else
+            printf("Falla en %.6f s: PWM no cortado por la ISR\n", s.t_falla);
+    }
+
+    if (s.traza)
+        fclose(s.traza);
+    if (eeprom)
+    {
+        FILE *f = fopen(eeprom, "wb");
+
+        if (!f || fwrite(s.eeprom, 1, sizeof(s.eeprom), f) != sizeof(s.eeprom))
+        {
+            fprintf(stderr, "%s: no se pudo guardar la EEPROM\n", eeprom);
+            return 1;
+        }
+        fclose(f);
+        printf("EEPROM: %u bytes escritos, %u eventos perdidos, parámetros %s\n", s.ee_escrituras,
+               EV_PERDIDOS, PAR_CARGADOS ? "de la EEPROM" : "compilados");
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file registro.c
+ * @brief Decodificador del registro de eventos y del bloque de parámetros de la
+ * EEPROM de datos (host).
+ *
+ * Compilación: sim/compilar.sh  (genera ./inversor_registro)
+ * Uso: ./inversor_registro <volcado>
+ *   volcado: 256 bytes en binario (eeprom= del simulador) o Intel HEX leído con el
+ *   programador; en el .hex del PIC18 la EEPROM de datos está en 0xF00000.
+ * Lista los eventos del más viejo al más nuevo con el formato de opciones.h y
+ * después los parámetros guardados, si el bloque es válido.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../include/opciones.h"
+
+#define EE_BYTES    256
+#define EE_HEX_BASE 0xF00000UL
+
+static unsigned hex_byte(const char *p) {
+    char b[3] = { p[0], p[1], 0 };
+    return (unsigned)strtoul(b, NULL, 16);
+}
+
+// Intel HEX: registros 00 (datos) y 04 (dirección lineal extendida)
+static int leer_hex(FILE *f, uint8_t *ee) {
+    char linea[600];
+    unsigned long alta = 0;
+    int datos = 0;
+
+    while (fgets(linea, sizeof(linea), f))
+    {
+        unsigned n, dir, tipo, i;
+        unsigned long abs_dir;
+
+        if (linea[0] != ':' || strlen(linea) < 11)
+            continue;
+        n = hex_byte(linea + 1);
+        dir = (hex_byte(linea + 3) << 8) | hex_byte(linea + 5);
+        tipo = hex_byte(linea + 7);
+        if (strlen(linea) < 11 + 2 * n)
+            return -1;
+        if (tipo == 0x04)
+            alta = ((unsigned long)hex_byte(linea + 9) << 24) | ((unsigned long)hex_byte(linea + 11) << 16);
+        else if (tipo == 0x00)
+        {
+            for (i = 0; i < n; i++)
+            {
+                abs_dir = alta + dir + i;
+                if (abs_dir >= EE_HEX_BASE && abs_dir < EE_HEX_BASE + EE_BYTES)
+                {
+                    ee[abs_dir - EE_HEX_BASE] = (uint8_t)hex_byte(linea + 9 + 2 * i);
+                    datos++;
+                }
+            }
+        }
+        else if (tipo == 0x01)
+            break;
+    }
+    return datos;
+}
+
+static uint8_t siguiente_seq(uint8_t s) {
+    s++;
+    return (s == EV_SEQ_VACIA) ? 0 : s;
+}
+
+// Nombres de los bits de tipo separados por '+'
+static void nombre_tipo(uint8_t t, char *txt, size_t n) {
+    static const char *nombres[8] = {
+        "sobrecorriente", "disipador", "trafo", "bateria", "falla-hw", "?", "?", "arranque"
+    };
+    int b;
+
+    txt[0] = '\0';
+    for (b = 0; b < 8; b++)
+    {
+        if (t & (1 << b))
+        {
+            if (txt[0])
+                strncat(txt, "+", n - strlen(txt) - 1);
+            strncat(txt, nombres[b], n - strlen(txt) - 1);
+        }
+    }
+    if (!txt[0])
+        strncpy(txt, "-", n);
+}
+
+// Mismo CRC que drivers.c
+static uint16_t crc16(uint16_t crc, uint8_t dato) {
+    uint8_t x = (uint8_t)(crc >> 8) ^ dato;
+
+    x ^= x >> 4;
+    return (uint16_t)((crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x);
+}
+
+static void imprimir_parametros(const uint8_t *b) {
+    static const char *nombres[PAR_CANTIDAD] = {
+        "kp", "ki", "kd", "REF0", "REF1", "V_MAX_0", "V_MAX_1", "I_MAX", "PP_MAX",
+        "T_DISIP1", "T_DISIP2", "HIS_DIS1", "HIS_DIS2", "T_TRAFO1", "T_TRAFO2",
+        "HIS_TRA1", "HIS_TRA2", "AA", "C_MAXIMA", "AJUSTADO"
+    };
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    if (b[0] == 0xFF)
+    {
+        printf("Parámetros: bloque borrado (valores compilados)\n");
+        return;
+    }
+    for (i = 0; i < PAR_BYTES - 2; i++)
+        crc = crc16(crc, b[i]);
+    if (b[0] != PAR_VERSION || crc != (((uint16_t)b[PAR_BYTES - 2] << 8) | b[PAR_BYTES - 1]))
+    {
+        printf("Parámetros: bloque inválido, versión %u (valores compilados)\n", b[0]);
+        return;
+    }
+    printf("Parámetros (versión %u):", b[0]);
+    for (i = 0; i < PAR_CANTIDAD; i++)
+        printf("%s%s=%u", (i % 8) ? " " : "\n  ", nombres[i], b[i + 1]);
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    uint8_t ee[EE_BYTES];
+    FILE *f;
+    int c, i, proximo = 0, eventos = 0;
+    uint8_t ant;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "uso: %s <volcado.bin | volcado.hex>\n", argv[0]);
+        return 1;
+    }
+    f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    memset(ee, 0xFF, sizeof(ee));
+    c = fgetc(f);
+    rewind(f);
+    if (c == ':')
+    {
+        if (leer_hex(f, ee) <= 0)
+        {
+            fprintf(stderr, "%s: sin datos de EEPROM (0x%06lX)\n", argv[1], EE_HEX_BASE);
+            fclose(f);
+            return 1;
+        }
+    }
+    else if (fread(ee, 1, EE_BYTES, f) != EE_BYTES)
+        fprintf(stderr, "%s: volcado corto, el resto se toma como borrado\n", argv[1]);
+    fclose(f);
+
+    // Mismo recorrido que inicializar_registro(): el próximo a escribir es el más viejo
+    ant = ee[EV_BASE + EV_SEQ];
+    if (ant != EV_SEQ_VACIA)
+    {
+        for (i = 1; i < EV_REGISTROS; i++)
+        {
+            uint8_t s = ee[EV_BASE + i * EV_BYTES + EV_SEQ];
+            if (s != siguiente_seq(ant))
+                break;
+            ant = s;
+        }
+        proximo = (i == EV_REGISTROS) ? 0 : i;
+    }
+
+    printf("seq  tipo                        ciclos      tiempo     I_SAL T_DIS T_TRA V_SAL\n");
+    for (i = 0; i < EV_REGISTROS; i++)
+    {
+        const uint8_t *r = ee + EV_BASE + ((proximo + i) % EV_REGISTROS) * EV_BYTES;
+        uint32_t ciclos;
+        char tipo[64];
+
+        if (r[EV_SEQ] == EV_SEQ_VACIA)
+            continue;
+        ciclos = ((uint32_t)r[EV_CICLOS] << 24) | ((uint32_t)r[EV_CICLOS + 1] << 16) |
+                 ((uint32_t)r[EV_CICLOS + 2] << 8) | r[EV_CICLOS + 3];
+        nombre_tipo(r[EV_TIPO], tipo, sizeof(tipo));
+        printf("%3u  %-24s%10u  %9.2f s  %5u %5u %5u %5u\n", r[EV_SEQ], tipo, ciclos, ciclos / 50.0,
+               r[EV_I_SALIDA], r[EV_T_DISIP], r[EV_T_TRAFO], r[EV_V_SALIDA]);
+        eventos++;
+    }
+    printf("%d eventos\n", eventos);
+    imprimir_parametros(ee + PAR_BASE);
+    return 0;
+}
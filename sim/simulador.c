@@ -0,0 +1,204 @@
+/**
+ * @file simulador.c
+ * @brief Simulador de lazo cerrado en el host: corre main(), pid(), las protecciones
+ * y la ISR del firmware real contra el modelo de la planta (planta.c).
+ * Parámetros, corrida y métricas; el main() de línea de comandos está en principal.c
+ * y el barrido paralelo en barrido.c.
+ *
+ * Parámetros (clave=valor):
+ *   t=2            Tiempo a simular [s]
+ *   carga=r        ninguna | r | rl | rect | motor
+ *   r=53 l=0.05 c=470e-6 r_arranque=8 tau_motor=0.3 t_carga=0 t_descarga=0 t_recarga=0
+ *   vbat=24 rbat=0.02 n=20.5 lf=3e-3 cf=10e-6 tm=0   Tiempo muerto por rama [us]
+ *   vbat_escalon=0 t_vbat=0   Cambio de la batería en vacío [V] en t_vbat [s]
+ *   kp= ki= kd= u= ref= i_max= pp_max= aa=   Reemplazan los valores de inicializar_variables()
+ *   his_dis1= his_dis2= his_tra1= his_tra2=
+ *   ref_err=128 t_disip=40 t_trafo=15 k_termico=0 tau_termico=60 i_minima=10 ahorro=0 tau_rc=2.5
+ *   sensado=pico | inst    falla=<s>  i_hw=<A>  wdt=1.0  subpasos=8
+ *   atasco=<s> t_atasco=<s>   La primera conversión de A/D del bucle desde t_atasco
+ *                  tarda atasco más: el ciclo se pasa de los 20 ms
+ *   guardar=1      Guarda los parámetros (con los reemplazos de arriba) en la EEPROM
+ *   reset=0        El micro sale del reset en t [s]; hasta ahí el puente está apagado
+ *   comando=<t>,<código>,<alto>,<bajo>   El display lo manda por SPI desde t [s] (COMANDOS_SPI)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../include/global_vars.h"
+#include "simulador.h"
+
+void sim_defecto(sim_t *s) {
+    memset(s, 0, sizeof(*s));
+    planta_defecto(&s->planta);
+    s->planta.t_pwm = SIM_T_TICK_US * 1e-6;
+    s->subpasos = 8;
+    memset(s->eeprom, 0xFF, sizeof(s->eeprom));     // EEPROM borrada
+
+    // AN0: 325 V pico -> 128 (REF_ERR). AN1: I_MAX = 242 a 1,5 x 6,15 A pico
+    s->k_v = 128.0 / 325.0;
+    s->k_i = 242.0 / (1.5 * 6.15);
+    s->tau_env = 0.2;
+    s->k_vbat = 255.0 / 32.0;
+    s->sensado_inst = REPETITIVO || PARALELO;  // Corrección por muestra y ángulo: AN0 instantánea
+    s->an_t_disip = 40;
+    s->an_t_trafo = 15;
+    s->k_termico = 0.0;
+    s->tau_termico = 60.0;
+    s->an_ref = 128;
+    s->an_i_minima = 10;
+    s->tau_rc = 2.5;
+
+    s->vbat_min = 21.0;
+    s->ahorro = 0;
+    s->i_disparo_hw = 0.0;
+    s->wdt_factor = 1.0;
+    s->t_falla = -1.0;
+    s->t_atasco = -1.0;
+    s->t_disparo = -1.0;
+    s->ticks_fin = (uint32_t)(2.0e6 / SIM_T_TICK_US);
+
+    s->fw_kp = s->fw_ki = s->fw_kd = -1;
+    s->fw_ref = s->fw_i_max = s->fw_pp_max = s->fw_aa = s->fw_u = -1;
+    s->fw_his_dis1 = s->fw_his_dis2 = s->fw_his_tra1 = s->fw_his_tra2 = -1;
+}
+
+// Interpreta un parámetro clave=valor. Devuelve 0 si la clave no existe.
+int sim_parametro(sim_t *s, const char *clave, const char *valor) {
+    double v = atof(valor);
+    planta_t *p = &s->planta;
+
+    if (!strcmp(clave, "t"))                s->ticks_fin = (uint32_t)(v * 1e6 / SIM_T_TICK_US);
+    else if (!strcmp(clave, "carga"))
+    {
+        if (!strcmp(valor, "ninguna"))      p->tipo = CARGA_NINGUNA;
+        else if (!strcmp(valor, "r"))       p->tipo = CARGA_R;
+        else if (!strcmp(valor, "rl"))      p->tipo = CARGA_RL;
+        else if (!strcmp(valor, "rect"))    p->tipo = CARGA_RECT;
+        else if (!strcmp(valor, "motor"))   p->tipo = CARGA_MOTOR;
+        else return 0;
+    }
+    else if (!strcmp(clave, "r"))           p->r = v;
+    else if (!strcmp(clave, "l"))           p->l = v;
+    else if (!strcmp(clave, "c"))           p->c_rect = v;
+    else if (!strcmp(clave, "r_arranque"))  p->r_arranque = v;
+    else if (!strcmp(clave, "tau_motor"))   p->tau_motor = v;
+    else if (!strcmp(clave, "t_carga"))     p->t_carga = v;
+    else if (!strcmp(clave, "t_descarga"))  p->t_descarga = v;
+    else if (!strcmp(clave, "t_recarga"))   p->t_recarga = v;
+    else if (!strcmp(clave, "vbat"))        p->vbat = v;
+    else if (!strcmp(clave, "rbat"))        p->rbat = v;
+    else if (!strcmp(clave, "vbat_escalon")) p->vbat_escalon = v;
+    else if (!strcmp(clave, "t_vbat"))      p->t_vbat = v;
+    else if (!strcmp(clave, "n"))           p->n = v;
+    else if (!strcmp(clave, "lf"))          p->lf = v;
+    else if (!strcmp(clave, "cf"))          p->cf = v;
+    else if (!strcmp(clave, "tm"))          p->tm = v * 1e-6;
+    else if (!strcmp(clave, "kp"))          s->fw_kp = atoi(valor);
+    else if (!strcmp(clave, "ki"))          s->fw_ki = atoi(valor);
+    else if (!strcmp(clave, "kd"))          s->fw_kd = atoi(valor);
+    else if (!strcmp(clave, "ref"))         s->fw_ref = atoi(valor);
+    else if (!strcmp(clave, "i_max"))       s->fw_i_max = atoi(valor);
+    else if (!strcmp(clave, "pp_max"))      s->fw_pp_max = atoi(valor);
+    else if (!strcmp(clave, "aa"))          s->fw_aa = atoi(valor);
+    else if (!strcmp(clave, "u"))           s->fw_u = atoi(valor);
+    else if (!strcmp(clave, "his_dis1"))    s->fw_his_dis1 = atoi(valor);
+    else if (!strcmp(clave, "his_dis2"))    s->fw_his_dis2 = atoi(valor);
+    else if (!strcmp(clave, "his_tra1"))    s->fw_his_tra1 = atoi(valor);
+    else if (!strcmp(clave, "his_tra2"))    s->fw_his_tra2 = atoi(valor);
+    else if (!strcmp(clave, "ref_err"))     s->an_ref = (uint8_t)atoi(valor);
+    else if (!strcmp(clave, "t_disip"))     s->an_t_disip = (uint8_t)atoi(valor);
+    else if (!strcmp(clave, "t_trafo"))     s->an_t_trafo = (uint8_t)atoi(valor);
+    else if (!strcmp(clave, "k_termico"))   s->k_termico = v;
+    else if (!strcmp(clave, "tau_termico")) s->tau_termico = v;
+    else if (!strcmp(clave, "i_minima"))    s->an_i_minima = (uint8_t)atoi(valor);
+    else if (!strcmp(clave, "ahorro"))      s->ahorro = atoi(valor) != 0;
+    else if (!strcmp(clave, "tau_rc"))      s->tau_rc = v;
+    else if (!strcmp(clave, "sensado"))     s->sensado_inst = !strcmp(valor, "inst");
+    else if (!strcmp(clave, "falla"))       s->t_falla = v;
+    else if (!strcmp(clave, "i_hw"))        s->i_disparo_hw = v;
+    else if (!strcmp(clave, "atasco"))      s->atasco = v;
+    else if (!strcmp(clave, "t_atasco"))    s->t_atasco = v;
+    else if (!strcmp(clave, "wdt"))         s->wdt_factor = v;
+    else if (!strcmp(clave, "guardar"))     s->guardar_par = atoi(valor) != 0;
+    else if (!strcmp(clave, "comando"))
+    {
+        int c, a, b;
+
+        if (s->n_cmd >= SIM_COMANDOS || sscanf(valor, "%lf,%i,%i,%i", &v, &c, &a, &b) != 4)
+            return 0;
+        s->cmd_t[s->n_cmd] = v;
+        s->cmd[s->n_cmd][0] = (uint8_t)c;
+        s->cmd[s->n_cmd][1] = (uint8_t)a;
+        s->cmd[s->n_cmd][2] = (uint8_t)b;
+        s->n_cmd++;
+    }
+    else if (!strcmp(clave, "reset"))       s->ticks_reset = (uint32_t)(v * 1e6 / SIM_T_TICK_US);
+    else if (!strcmp(clave, "subpasos"))    s->subpasos = atoi(valor) > 0 ? atoi(valor) : 1;
+    else return 0;
+    return 1;
+}
+
+// Corre el firmware desde el reset hasta ticks_fin
+void sim_correr(sim_t *s) {
+    sim = s;
+    sim_arrancar();
+    if (!setjmp(s->salida))
+    {
+        sim_esperar_reset();
+        main_firmware();
+    }
+}
+
+// Métricas de una corrida terminada: establecimiento y sobrepico sobre el Vrms
+// por ciclo, THD por DFT del último ciclo (una muestra por tick de Timer2)
+void sim_metricas(const sim_t *s, sim_metricas_t *m) {
+    uint32_t n = s->ciclos < SIM_MAX_CICLOS ? s->ciclos : SIM_MAX_CICLOS;
+    uint32_t i, j, ultimos;
+    double final = 0.0, maximo = 0.0, banda;
+    double h1 = 0.0, h_resto = 0.0;
+    int k;
+
+    memset(m, 0, sizeof(*m));
+    m->disparos = s->disparos;
+    m->ciclos = s->ciclos;
+    m->t_establecimiento = -1.0;
+    if (n == 0)
+        return;
+
+    ultimos = n < 5 ? n : 5;
+    for (i = n - ultimos; i < n; i++)
+        final += s->vrms_ciclo[i];
+    final /= ultimos;
+    m->vrms = final;
+
+    for (i = 0; i < n; i++)
+        if (s->vrms_ciclo[i] > maximo)
+            maximo = s->vrms_ciclo[i];
+    if (final > 0.0 && maximo > final)
+        m->sobrepico = 100.0 * (maximo - final) / final;
+
+    // Primer ciclo desde el cual todos quedan en la banda
+    banda = 0.02 * final;
+    for (i = n; i > 0 && fabs(s->vrms_ciclo[i - 1] - final) <= banda; i--)
+        ;
+    if (i < n && final > 0.0)
+        m->t_establecimiento = (i > 0) ? s->t_ciclo[i - 1] : 0.0;
+
+    for (k = 1; k <= SIM_ARMONICOS && 2 * k < (int)s->n_ultimo; k++)
+    {
+        double re = 0.0, im = 0.0, w = 2.0 * M_PI * k / s->n_ultimo;
+        for (j = 0; j < s->n_ultimo; j++)
+        {
+            re += s->v_ultimo[j] * cos(w * j);
+            im -= s->v_ultimo[j] * sin(w * j);
+        }
+        if (k == 1)
+            h1 = re * re + im * im;
+        else
+            h_resto += re * re + im * im;
+    }
+    if (h1 > 0.0)
+        m->thd = 100.0 * sqrt(h_resto / h1);
+}
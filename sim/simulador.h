@@ -0,0 +1,146 @@
+/**
+ * @file simulador.h
+ * @brief Estado del simulador de host: planta, sensores, reloj y estadísticas.
+ */
+
+#ifndef SIMULADOR_H
+#define SIMULADOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include "planta.h"
+
+#define SIM_FOSC            20e6                    // Cristal [Hz]
+#define SIM_T_TICK_US       51.2                    // Período PWM (PR2 = 255, 1:1) [us]
+#define SIM_T_ADC_US        8.8                     // 11 TAD a Fosc/16
+#define SIM_T_ENTRADA_ISR_US 6.6                    // Latencia + salvado de contexto XC8 (~33 Tcy)
+#define SIM_WDT_NOM_TICKS   1280                    // WDTPS = 16 -> 65,5 ms
+#define SIM_MAX_CICLOS      1500                    // Vrms por ciclo guardados (30 s)
+#define SIM_MAX_MUESTRAS    512                     // Muestras por ciclo para el THD (392 ticks)
+#define SIM_ARMONICOS       40                      // Armónicos incluidos en el THD
+#define SIM_EE_TICKS        79                      // Escritura de un byte de EEPROM (4 ms)
+#define SIM_EE_BYTES        256
+#define SIM_COMANDOS        8                       // comando=<t>,<código>,<alto>,<bajo>
+
+typedef struct sim_s {
+    planta_t planta;
+    int subpasos;               // Subpasos de integración por tick PWM
+
+    // Sensado (cuentas ADC de 8 bits)
+    double k_v;                 // Cuentas por voltio de salida
+    double k_i;                 // Cuentas por amper de salida
+    double tau_env;             // Constante de descarga del detector de pico [s]
+    double k_vbat;              // Cuentas por voltio de batería (CANAL_VBAT)
+    int sensado_inst;           // 1 = AN0 instantánea (rectificada, sin retención)
+    double env_v, env_i;
+    uint8_t an_t_disip, an_t_trafo, an_ref, an_i_minima;
+    double k_termico;           // Cuentas de AN2/AN4 por A^2 eficaz de salida (0 = fijas)
+    double tau_termico;         // Constante térmica de disipador y trafo [s]
+    double temp_disip, temp_trafo;
+    double tau_rc;              // Constante del RC de la prueba de carga (AN9) [s]
+    double rc;                  // Tensión del RC [cuentas]
+
+    // Pines y protección
+    double vbat_min;            // Umbral del comparador de V_BAT (RA4) [V]
+    int ahorro;                 // Llave de Bajo Consumo (RC6)
+    double i_disparo_hw;        // Disparo del FF por corriente del inductor (0 = sin disparo) [A]
+    int ff;                     // FF de protección disparado
+    double wdt_factor;          // Error del INTRC (1.0 = nominal)
+
+    // Inyección de falla y latencia medida
+    double t_falla;             // Instante de la falla (< 0 = sin falla) [s]
+    int falla_pendiente;
+    double t_falla_real;
+    double latencia_falla_us;   // Falla -> CCP1/CCP2 deshabilitados (< 0 = no medida)
+
+    // Costo de la ISR de Timer2 en el host (MEDIR_ISR): el simulador no avanza
+    // TMR2 dentro de la ISR, así que ISR_TCY no mide nada acá
+    double isr_ns;
+    uint32_t isr_n;
+
+    // Atasco del bucle principal: una conversión de A/D que tarda atasco [s]
+    double t_atasco;            // Desde este instante (< 0 = sin atasco) [s]
+    double atasco;
+    int atasco_hecho;
+    double t_disparo;           // Primer apagado total (< 0 = ninguno) [s]
+
+    // Reloj
+    uint32_t ticks;
+    uint32_t ticks_fin;
+    uint32_t ticks_reset;       // El micro sale del reset en este tick (puente apagado hasta ahí)
+    double resto_us;            // Tiempo de CPU consumido dentro del tick actual
+    double t_evento_us;         // Instante del último evento de hardware
+    int en_isr;
+    int configurado;
+    jmp_buf salida;
+    double d1, d2;              // Duty latcheado por Timer2 (0..1)
+
+    // Ajustes del firmware tras inicializar_variables() (-1 = sin cambio)
+    int fw_kp, fw_ki, fw_kd, fw_ref, fw_i_max, fw_pp_max, fw_aa, fw_u;
+    int fw_his_dis1, fw_his_dis2, fw_his_tra1, fw_his_tra2;
+    int guardar_par;            // guardar_parametros() después de los ajustes
+
+    // EEPROM de datos: persiste entre arranques (eeprom=<archivo> en principal.c)
+    uint8_t eeprom[SIM_EE_BYTES];
+    int ee_ticks;               // Ticks hasta terminar la escritura en curso (0 = libre)
+    uint8_t ee_dir, ee_dato;
+    uint32_t ee_escrituras;
+
+    // MSSP (telemetría)
+    uint32_t spi_bytes;         // Bytes transmitidos por enviar()
+    uint8_t spi_rx;             // Byte recibido por SDI en la última transferencia
+    double cmd_t[SIM_COMANDOS]; // El display manda cada comando desde cmd_t [s]
+    uint8_t cmd[SIM_COMANDOS][3];
+    int n_cmd, cmd_sig, cmd_byte;
+
+    // Operación en paralelo (paralelo.c): se llama al final de cada tick
+    int unidad;
+    void (*sincronizar)(struct sim_s *s);
+    uint8_t sync_salida;        // LATB7 al final del tick (SYNC_OSC del maestro)
+    uint8_t sync_entrada;       // Nivel que ve RB7 si es entrada (SYNC_ENTRADA del esclavo)
+
+    // Estadísticas
+    uint8_t ciclo_ant;
+    uint8_t semiciclos;
+    double suma_v2, suma_i2;
+    uint32_t muestras;
+    double vrms, irms;
+    uint32_t ciclos;
+    uint32_t disparos;
+    uint8_t buzzer_ant;
+    FILE *traza;
+
+    // Formas de onda para las métricas (ver sim_metricas)
+    float vrms_ciclo[SIM_MAX_CICLOS];
+    float t_ciclo[SIM_MAX_CICLOS];          // Fin de cada ciclo [s]
+    float v_muestras[SIM_MAX_MUESTRAS];     // Ciclo en curso, una muestra por tick
+    float v_ultimo[SIM_MAX_MUESTRAS];       // Último ciclo completo
+    uint16_t n_muestras, n_ultimo;
+} sim_t;
+
+// Resultado de una corrida, para comparar escenarios
+typedef struct {
+    double vrms;                // Vrms final (promedio de los últimos 5 ciclos) [V]
+    double t_establecimiento;   // Desde el arranque hasta quedar en la banda del 2 % [s] (< 0 = no se estableció)
+    double sobrepico;           // Máximo por encima del valor final [%]
+    double thd;                 // Distorsión armónica del último ciclo [%]
+    uint32_t disparos;          // Apagados totales (PREVIO<7>)
+    uint32_t ciclos;
+} sim_metricas_t;
+
+extern sim_t *sim;
+
+void sim_defecto(sim_t *s);
+int sim_parametro(sim_t *s, const char *clave, const char *valor);
+void sim_arrancar(void);
+void sim_correr(sim_t *s);
+void sim_metricas(const sim_t *s, sim_metricas_t *m);
+void sim_avanzar_us(double us);
+void sim_esperar_reset(void);
+
+// Firmware (main.c compilado con -Dmain=main_firmware, ISR de pwm.c)
+void main_firmware(void);
+void isr(void);
+
+#endif // SIMULADOR_H
@@ -0,0 +1,202 @@
+/**
+ * @file xc.h
+ * @brief Modelo de registros del PIC18F2520 para compilar el firmware en el host.
+ * Reemplaza al <xc.h> de XC8 cuando se compila con -Isim -DSIMULADOR.
+ * Cada SFR es un byte en RAM; los "bits" son campos anónimos sobre ese mismo byte.
+ * El conversor A/D se resuelve al leer GO: ver sim_adcon0() en perifericos.c.
+ * La EEPROM de datos lee al acceder a EEDATA con RD en 1 y escribe con WR en el
+ * tick siguiente, con EEIF al terminar: ver sim_eedata() y eeprom_tick().
+ * Timer1 cuenta por tick y leer TMR1L suma el tiempo ya consumido dentro del tick
+ * y latchea TMR1H (RD16): ver sim_tmr1l().
+ * El MSSP en modo maestro transmite al acceder a SSPBUF con SSPIF en 0: consume
+ * el tiempo del byte y levanta SSPIF (ver sim_sspbuf()).
+ */
+
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+#include <stdint.h>
+
+// Registro de 8 bits con acceso por bits (mismo orden LSB primero que XC8)
+#define SIM_SFR(nombre, ...) \
+    typedef union { uint8_t reg; struct { __VA_ARGS__ }; } nombre##_t; \
+    extern volatile nombre##_t sim_##nombre
+
+// Registro de 8 bits sin bits con nombre
+#define SIM_REG(nombre) extern volatile uint8_t sim_##nombre
+
+SIM_SFR(PORTA, unsigned RA0:1, RA1:1, RA2:1, RA3:1, RA4:1, RA5:1, RA6:1, RA7:1;);
+SIM_SFR(PORTB, unsigned RB0:1, RB1:1, RB2:1, RB3:1, RB4:1, RB5:1, RB6:1, RB7:1;);
+SIM_SFR(PORTC, unsigned RC0:1, RC1:1, RC2:1, RC3:1, RC4:1, RC5:1, RC6:1, RC7:1;);
+SIM_SFR(LATA, unsigned LATA0:1, LATA1:1, LATA2:1, LATA3:1, LATA4:1, LATA5:1, LATA6:1, LATA7:1;);
+SIM_SFR(LATB, unsigned LATB0:1, LATB1:1, LATB2:1, LATB3:1, LATB4:1, LATB5:1, LATB6:1, LATB7:1;);
+SIM_SFR(LATC, unsigned LATC0:1, LATC1:1, LATC2:1, LATC3:1, LATC4:1, LATC5:1, LATC6:1, LATC7:1;);
+SIM_SFR(TRISA, unsigned TRISA0:1, TRISA1:1, TRISA2:1, TRISA3:1, TRISA4:1, TRISA5:1, TRISA6:1, TRISA7:1;);
+SIM_SFR(TRISB, unsigned TRISB0:1, TRISB1:1, TRISB2:1, TRISB3:1, TRISB4:1, TRISB5:1, TRISB6:1, TRISB7:1;);
+SIM_SFR(TRISC, unsigned TRISC0:1, TRISC1:1, TRISC2:1, TRISC3:1, TRISC4:1, TRISC5:1, TRISC6:1, TRISC7:1;);
+
+SIM_SFR(ADCON0, unsigned ADON:1, GO:1, CHS:4, :2;);
+SIM_SFR(ADCON1, unsigned PCFG:4, VCFG0:1, VCFG1:1, :2;);
+SIM_SFR(ADCON2, unsigned ADCS:3, ACQT:3, :1, ADFM:1;);
+SIM_REG(ADRESH);
+SIM_REG(ADRESL);
+
+SIM_REG(CCPR1L);
+SIM_REG(CCPR2L);
+// CCPxCON: DCxB se accede como campo de 2 bits o como DCxB1:DCxB0
+typedef union {
+    uint8_t reg;
+    struct { unsigned CCP1M:4, DC1B0:1, DC1B1:1, :2; };
+    struct { unsigned :4, DC1B:2, :2; };
+} CCP1CON_t;
+extern volatile CCP1CON_t sim_CCP1CON;
+typedef union {
+    uint8_t reg;
+    struct { unsigned CCP2M:4, DC2B0:1, DC2B1:1, :2; };
+    struct { unsigned :4, DC2B:2, :2; };
+} CCP2CON_t;
+extern volatile CCP2CON_t sim_CCP2CON;
+SIM_REG(PR2);
+SIM_REG(TMR2);
+SIM_SFR(T2CON, unsigned T2CKPS:2, TMR2ON:1, TOUTPS:4, :1;);
+
+SIM_SFR(T0CON, unsigned T0PS:3, PSA:1, T0SE:1, T0CS:1, T08BIT:1, TMR0ON:1;);
+SIM_SFR(T1CON, unsigned TMR1ON:1, TMR1CS:1, NOT_T1SYNC:1, T1OSCEN:1, T1CKPS:2, T1RUN:1, RD16:1;);
+
+SIM_SFR(INTCON, unsigned RBIF:1, INT0IF:1, TMR0IF:1, RBIE:1, INT0IE:1, TMR0IE:1, PEIE:1, GIE:1;);
+SIM_SFR(INTCON2, unsigned RBIP:1, :1, TMR0IP:1, :1, INTEDG2:1, INTEDG1:1, INTEDG0:1, RBPU:1;);
+SIM_SFR(INTCON3, unsigned INT1IF:1, INT2IF:1, :1, INT1IE:1, INT2IE:1, :1, INT1IP:1, INT2IP:1;);
+SIM_SFR(RCON, unsigned BOR:1, POR:1, PD:1, TO:1, RI:1, :1, SBOREN:1, IPEN:1;);
+SIM_SFR(PIE1, unsigned TMR1IE:1, TMR2IE:1, CCP1IE:1, SSPIE:1, TXIE:1, RCIE:1, ADIE:1, PSPIE:1;);
+SIM_SFR(PIR1, unsigned TMR1IF:1, TMR2IF:1, CCP1IF:1, SSPIF:1, TXIF:1, RCIF:1, ADIF:1, PSPIF:1;);
+SIM_SFR(PIE2, unsigned CCP2IE:1, TMR3IE:1, HLVDIE:1, BCLIE:1, EEIE:1, :1, CMIE:1, OSCFIE:1;);
+SIM_SFR(PIR2, unsigned CCP2IF:1, TMR3IF:1, HLVDIF:1, BCLIF:1, EEIF:1, :1, CMIF:1, OSCFIF:1;);
+
+SIM_SFR(SSPCON1, unsigned SSPM:4, CKP:1, SSPEN:1, SSPOV:1, WCOL:1;);
+SIM_SFR(SSPSTAT, unsigned BF:1, UA:1, R_NOT_W:1, S:1, P:1, D_NOT_A:1, CKE:1, SMP:1;);
+extern volatile uint8_t sim_SSPBUF;
+
+SIM_SFR(EECON1, unsigned RD:1, WR:1, WREN:1, WRERR:1, FREE:1, :1, CFGS:1, EEPGD:1;);
+SIM_REG(EEADR);
+SIM_REG(EECON2);
+extern volatile uint8_t sim_EEDATA;
+
+SIM_SFR(OSCCON, unsigned SCS:2, IOFS:1, OSTS:1, IRCF:3, IDLEN:1;);
+SIM_SFR(WDTCON, unsigned SWDTEN:1, :7;);
+SIM_SFR(CMCON, unsigned CM:3, CIS:1, C1INV:1, C2INV:1, C1OUT:1, C2OUT:1;);
+SIM_SFR(CVRCON, unsigned CVR:4, CVRSS:1, CVRR:1, CVROE:1, CVREN:1;);
+SIM_SFR(HLVDCON, unsigned HLVDL:4, HLVDEN:1, IRVST:1, :1, VDIRMAG:1;);
+
+SIM_REG(WREG);
+SIM_SFR(STATUS, unsigned C:1, DC:1, Z:1, OV:1, N:1, :3;);
+
+// Timer0 de 16 bits: el simulador incrementa el contador completo
+typedef union { uint16_t cuenta; struct { uint8_t l; uint8_t h; } b; } sim_tmr16_t;
+extern volatile sim_tmr16_t sim_TMR0;
+extern volatile sim_tmr16_t sim_TMR1;
+SIM_REG(TMR1H);
+
+// --- Nombres XC8 ---
+#define PORTA       sim_PORTA.reg
+#define PORTAbits   sim_PORTA
+#define PORTB       sim_PORTB.reg
+#define PORTBbits   sim_PORTB
+#define PORTC       sim_PORTC.reg
+#define PORTCbits   sim_PORTC
+#define LATA        sim_LATA.reg
+#define LATAbits    sim_LATA
+#define LATB        sim_LATB.reg
+#define LATBbits    sim_LATB
+#define LATC        sim_LATC.reg
+#define LATCbits    sim_LATC
+#define TRISA       sim_TRISA.reg
+#define TRISAbits   sim_TRISA
+#define TRISB       sim_TRISB.reg
+#define TRISBbits   sim_TRISB
+#define TRISC       sim_TRISC.reg
+#define TRISCbits   sim_TRISC
+
+#define ADCON0      sim_ADCON0.reg
+#define ADCON0bits  (*sim_adcon0())    // Leer GO completa la conversión
+#define ADCON1      sim_ADCON1.reg
+#define ADCON2      sim_ADCON2.reg
+#define ADRESH      sim_ADRESH
+#define ADRESL      sim_ADRESL
+
+#define CCPR1L      sim_CCPR1L
+#define CCPR2L      sim_CCPR2L
+#define CCP1CON     sim_CCP1CON.reg
+#define CCP1CONbits sim_CCP1CON
+#define CCP2CON     sim_CCP2CON.reg
+#define CCP2CONbits sim_CCP2CON
+#define PR2         sim_PR2
+#define TMR2        sim_TMR2
+#define T2CON       sim_T2CON.reg
+#define T2CONbits   sim_T2CON
+
+#define T0CON       sim_T0CON.reg
+#define T0CONbits   sim_T0CON
+#define TMR0L       sim_TMR0.b.l
+#define TMR0H       sim_TMR0.b.h
+#define T1CON       sim_T1CON.reg
+#define T1CONbits   sim_T1CON
+#define TMR1L       (*sim_tmr1l())      // Latchea TMR1H
+#define TMR1H       sim_TMR1H
+
+#define INTCON      sim_INTCON.reg
+#define INTCONbits  sim_INTCON
+#define INTCON2     sim_INTCON2.reg
+#define INTCON2bits sim_INTCON2
+#define INTCON3     sim_INTCON3.reg
+#define INTCON3bits sim_INTCON3
+#define RCON        sim_RCON.reg
+#define RCONbits    sim_RCON
+#define PIE1        sim_PIE1.reg
+#define PIE1bits    sim_PIE1
+#define PIR1        sim_PIR1.reg
+#define PIR1bits    sim_PIR1
+#define PIE2        sim_PIE2.reg
+#define PIE2bits    sim_PIE2
+#define PIR2        sim_PIR2.reg
+#define PIR2bits    sim_PIR2
+
+#define SSPCON1     sim_SSPCON1.reg
+#define SSPCON1bits sim_SSPCON1
+#define SSPSTAT     sim_SSPSTAT.reg
+#define SSPSTATbits sim_SSPSTAT
+#define SSPBUF      (*sim_sspbuf())     // Con SSPIF en 0 empieza un byte
+
+#define EECON1      sim_EECON1.reg
+#define EECON1bits  sim_EECON1
+#define EEADR       sim_EEADR
+#define EECON2      sim_EECON2
+#define EEDATA      (*sim_eedata())     // Con RD en 1 se carga desde la EEPROM
+
+#define OSCCON      sim_OSCCON.reg
+#define OSCCONbits  sim_OSCCON
+#define WDTCON      sim_WDTCON.reg
+#define WDTCONbits  sim_WDTCON
+#define CMCON       sim_CMCON.reg
+#define CVRCON      sim_CVRCON.reg
+#define HLVDCON     sim_HLVDCON.reg
+
+#define WREG        sim_WREG
+#define STATUS      sim_STATUS.reg
+
+// --- Intrínsecos ---
+volatile ADCON0_t *sim_adcon0(void);
+volatile uint8_t *sim_eedata(void);
+volatile uint8_t *sim_tmr1l(void);
+volatile uint8_t *sim_sspbuf(void);
+void sim_sleep(void);
+void sim_demora_us(uint16_t us);
+void sim_tick(void);
+
+#define __interrupt(...)
+#define SLEEP()         sim_sleep()
+#define NOP()           ((void)0)
+#define CLRWDT()        ((void)0)
+#define _delay_us(x)    sim_demora_us(x)
+#define __delay_us(x)   sim_demora_us(x)
+
+#endif // SIM_XC_H
@@ -13,6 +13,7 @@ void FXM1616U(void);
 void FXM2416U(void);
 void FXD2416U(void);
 void _24_BitAdd(void);
+void _24_bit_sub(void);
 void MagAndSub(void);
 void SpecSign(void);
 // Prototipos internos PID
@@ -21,13 +22,30 @@ void Integral(void);
 void Derivative(void);
 void GetPidResult(void);
 void PidInterrupt(void);
+void GetA_Error(void);
+void DeltaError(void);
 
 // --- FUNCIONES DE PROTECCIÓN Y ESTADO ---
 
 void i_salida(void) {
+    TRAZA(TP_I_SALIDA);
+
     // Leer corriente de salida (AN1)
-    leer_AD(0b00000100);  // AN1
-    I_SALIDA = ADRESH;
+#if AD_SINCRONO
+    if (AD_LISTO & AD_LISTO_I)
+    {
+        // Mayor de las lecturas de la ISR desde el ciclo anterior
+        PIE1bits.TMR2IE = 0;
+        I_SALIDA = I_SINC;
+        I_SINC = 0;
+        AD_LISTO &= ~AD_LISTO_I;
+        PIE1bits.TMR2IE = 1;
+    }
+    else
+#endif
+    {
+        I_SALIDA = leer_AD(1);  // AN1
+    }
 
     // Comparación con I_MAX
     if (I_SALIDA < I_MAX)
@@ -55,20 +73,78 @@ void i_salida(void) {
             SPI_SDO = 0;
         }
     }
+    TRAZA(TP_I_SALIDA_FIN);
 }
 
 void pid(void) {
+    TRAZA(TP_PID);
     pid_1();
     pid_2();
     pid_3();
     pid_4();
+    TRAZA(TP_PID_FIN);
+}
+
+#if SINCRONISMO == SINC_ESCLAVO
+static uint16_t leer_timer0(void) {
+    uint16_t t;
+
+    t = TMR0L;                      // Leer L primero: latchea TMR0H
+    t |= (uint16_t)TMR0H << 8;
+    return t;
 }
 
+// Antes de largar Timer2: espera el flanco de subida del maestro en SYNC_ENTRADA y
+// SINC_DESFASE ticks más (Timer0 cuenta 51,2 us, un tick). Sin maestro vuelve a los
+// SINC_ESPERA ticks y el esclavo arranca libre; la ISR se engancha después.
+static void esperar_maestro(void) {
+    uint16_t t0 = leer_timer0();
+    uint8_t anterior = SYNC_ENTRADA;   // Un 1 al entrar no es flanco
+
+    while (!SYNC_ENTRADA || anterior)
+    {
+        anterior = SYNC_ENTRADA;
+        if ((uint16_t)(leer_timer0() - t0) >= SINC_ESPERA)
+            return;
+        ESPERA_TICK();
+    }
+#if SINC_DESFASE
+    t0 = leer_timer0();
+    while ((uint16_t)(leer_timer0() - t0) < SINC_DESFASE)
+        ESPERA_TICK();
+#endif
+}
+#endif
+
 void encender(void) {
+    uint8_t ciclo = 0;  // Ciclos de rampa completos (satura en 2)
+
+    TRAZA(TP_ENCENDER);
+
     // Inicialización
+    borrar_repetitivo();
+    borrar_observador();
+    borrar_thd();
     NN = 1;
+    K = 0;      // Timer2 parado: el primer semiciclo es el positivo
+#if AD_SINCRONO
+    AD_LISTO = 0;   // Nada de lo leído antes del apagado
+    I_SINC = 0;
+    AD_ISR = 0;     // Ni una conversión que quedó sin recoger al parar Timer2
+    ADCON0 = 0;
+#endif
     V_PICO_0 = INICIO_0;
     V_PICO_1 = INICIO_1;
+    CCPR1L = 0;
+    CCPR2L = 0;
+    CCP1CON = 0b00001100;  // Módulos PWM (la ISR de falla los deshabilita)
+    CCP2CON = 0b00001100;
+#if SINCRONISMO == SINC_ESCLAVO
+    // La tabla arranca desde su punto 0 en fase con el maestro
+    CICLO_0 = 0;
+    borrar_sincronismo();
+    esperar_maestro();
+#endif
     TMR2 = 0;  // Reset Timer2
     T2CONbits.TMR2ON = 1;  // Enciende Timer2 (arranca PWM)
 
@@ -76,7 +152,7 @@ void encender(void) {
     while (1)
     {
         // Protección por hardware
-        if (PORTCbits.RC6 == 0)
+        if (FALLA_HW == 0)
         {
             ESTADO |= (1 << 6);
             PREVIO |= (1 << 7);  // Indica que hay que apagar
@@ -88,15 +164,16 @@ void encender(void) {
         }
 
         // Inicio de ciclo de 50 Hz
-        SYNC_OSC = 1;
-        K = 0;
-        SYNC_OSC = 0;
+        MARCA_CICLO(1);
+        K &= 0x01;
+        MARCA_CICLO(0);
 
         // ¿Llegó a V_MAX? (comparación de 16 bits)
         if ((V_PICO_0 > V_MAX_0) ||
             ((V_PICO_0 == V_MAX_0) && (V_PICO_1 > V_MAX_1)))
         {
             PREVIO &= ~(1 << 7);  // Arranque OK
+            marcar_arranque(ARR_POTENCIA);
             return;
         }
 
@@ -136,27 +213,47 @@ void encender(void) {
             ESTADO &= ~(1 << 5);
         }
 
+        // Prueba de carga: I_SALIDA ya tiene el primer ciclo completo de la rampa,
+        // hecho con V_PICO - AA
+        if (ciclo == 1)
+        {
+            marcar_arranque(ARR_PRUEBA);
+#if ARRANQUE_RAPIDO
+            uint16_t v = ((uint16_t)V_PICO_0 << 8) | V_PICO_1;
+            if (v < ARR_INICIO_RAPIDO &&
+                (uint32_t)I_SALIDA * ARR_INICIO_RAPIDO <= (uint32_t)(I_MAX >> ARR_MARGEN) * (v - AA))
+            {
+                V_PICO_0 = (uint8_t)(ARR_INICIO_RAPIDO >> 8);
+                V_PICO_1 = (uint8_t)(ARR_INICIO_RAPIDO & 0xFF);
+            }
+#endif
+        }
+        if (ciclo < 2)
+            ciclo++;
+
         /* Espera fin del ciclo de 50 Hz */
-        while (K != 2)
-            ;
+        while (K < 2 && !FALLA_ACTIVA)
+            ESPERA_TICK();
     }
 }
 
 void apagar(void) {
+    TRAZA(TP_APAGAR);
+
     // Buzzer ON
     BUZZER = 1;
     NN = 1;
     while (1)
     {
          // Protección por hardware
-        if (PORTCbits.RC6 == 0)
+        if (FALLA_HW == 0)
         {
             ESTADO |= (1 << 6);  // protección hardware activa
             T2CONbits.TMR2ON = 0;  // apago Timer2 (PWM)
 
             // Espera reset manual
-            while (PORTCbits.RC6 == 0)
-                ;
+            while (FALLA_HW == 0)
+                ESPERA_TICK();
             goto rearme;
         }
         else
@@ -165,9 +262,9 @@ void apagar(void) {
         }
 
         // Sincronismo ciclo 50 Hz
-        SYNC_OSC = 1;
-        K = 0;
-        SYNC_OSC = 0;
+        MARCA_CICLO(1);
+        K &= 0x01;
+        MARCA_CICLO(0);
 
          // ¿V_PICO > AA?
          uint16_t v_pico = ((uint16_t)V_PICO_0 << 8) | V_PICO_1;
@@ -178,18 +275,21 @@ void apagar(void) {
             V_PICO_1 = v_pico & 0xFF;
 
             // Esperar fin del ciclo de 50 Hz
-            while (K != 2)
-                ;
+            while (K < 2 && !FALLA_ACTIVA)
+                ESPERA_TICK();
         }
         else
         {
 
-             // Apagado duro del puente H
+             // Apagado duro del puente H (no es falla: se enmascara INT0)
+             INTCONbits.INT0IE = 0;
              PORTCbits.RC0 = 1;   // dispara FF D ->apaga IR2110
-            while (PORTCbits.RC6 == 0)
-                ;
+            while (FALLA_HW == 0)
+                ESPERA_TICK();
 
             PORTCbits.RC0 = 0;  // libera FF D
+            INTCONbits.INT0IF = 0;
+            INTCONbits.INT0IE = 1;
             T2CONbits.TMR2ON = 0;
             break;  // salgo del soft-stop
         }
@@ -201,8 +301,9 @@ void apagar(void) {
         // Apagado por sobrecorriente -> esperar reset
         while (1)
         {
-            if (PORTCbits.RC6 == 1)
+            if (FALLA_HW == 1)
                 break;
+            ESPERA_TICK();
         }
     }
 
@@ -223,8 +324,8 @@ rearme:
 
     // Reset del flip-flop D
     PORTBbits.RB1 = 1;
-    while (PORTCbits.RC6 == 0)
-        ;
+    while (FALLA_HW == 0)
+        ESPERA_TICK();
     PORTBbits.RB1 = 0;
 
     // Intento reencender
@@ -232,17 +333,22 @@ rearme:
 
     // Si falló, repetir apagado
     if (PREVIO & (1 << 7))
+    {
+        registrar_falla();
         apagar();
+    }
 }
 
 void apagar_1(void) {
     uint16_t v_pico;
+
+    TRAZA(TP_APAGAR_1);
     NN = 1;
     while (1)
     {
 
         // Protección por hardware
-        if (PORTCbits.RC6 == 0)
+        if (FALLA_HW == 0)
         {
             ESTADO |= (1 << 6);  // Protección hardware activa
             PREVIO |= (1 << 7);  // Indica que debe ir a apagar()
@@ -254,9 +360,9 @@ void apagar_1(void) {
         }
 
         // Sincronización a 50 Hz
-        SYNC_OSC = 1;
-        K = 0;
-        SYNC_OSC = 0;
+        MARCA_CICLO(1);
+        K &= 0x01;
+        MARCA_CICLO(0);
 
         // ¿V_PICO > AA?
         v_pico = ((uint16_t)V_PICO_0 << 8) | V_PICO_1;
@@ -271,12 +377,14 @@ void apagar_1(void) {
         V_PICO_1 = v_pico & 0xFF;
 
         // Espera fin del ciclo de 50 Hz
-        while (K != 2)
-            ;
+        while (K < 2 && !FALLA_ACTIVA)
+            ESPERA_TICK();
     }
 }
 
 void out_fija(void) {
+    TRAZA(TP_OUT_FIJA);
+
     // Inicialización
     CUENTA = 0;  // contador de ciclos de 50 Hz
     NN = 1;
@@ -289,7 +397,7 @@ void out_fija(void) {
     {
 
         // Protección por hardware
-        if (PORTCbits.RC6 == 0)
+        if (FALLA_HW == 0)
         {
             ESTADO |= (1 << 6);
             PREVIO |= (1 << 7);  // forzar apagado total
@@ -301,9 +409,9 @@ void out_fija(void) {
         }
 
         // Sincronización a 50 Hz
-        SYNC_OSC = 1;
-        K = 0;
-        SYNC_OSC = 0;
+        MARCA_CICLO(1);
+        K &= 0x01;
+        MARCA_CICLO(0);
 
         // Protección por corriente
         i_salida();
@@ -334,16 +442,15 @@ void out_fija(void) {
         }
 
         // Medición de corriente para Bajo Consumo
-        leer_AD(1);  // AN1 -> corriente de salida
-        I_SALIDA = ADRESH;
+        I_SALIDA = leer_AD(1);  // AN1 -> corriente de salida
         if (I_SALIDA >= I_MINIMA)
         {
             PREVIO |= (1 << 6);   // hay carga -> salir de Bajo Consumo
         }
 
         // Espera fin del ciclo de 50 Hz
-        while (K != 2)
-            ;
+        while (K < 2 && !FALLA_ACTIVA)
+            ESPERA_TICK();
 
         // Incremento del contador
         CUENTA++;
@@ -356,9 +463,19 @@ void out_fija(void) {
 }
 
 void prueba(void) {
+    uint8_t rc;
+    uint8_t rc_anterior;
+
+    TRAZA(TP_PRUEBA);
+
     PORTCbits.RC7 = 1;  // Mantiene descargado el capacitor del RC
 
 inicio_prueba:
+    // Arranca la medición de tiempo dormido de esta prueba
+    contar_activo();
+    T_ACTIVO = 0;
+    T_DORMIDO = 0;
+
     apagar_1();  // Apagado suave por software
 
     // Si hubo sobrecorriente durante apagar_1 -> apagar total
@@ -370,12 +487,28 @@ inicio_prueba:
     T2CONbits.TMR2ON = 0;  // Apaga el Timer2 (PWM detenido)
     PORTCbits.RC7 = 0;  // Comienza la carga del capacitor RC
 
-    // Espera hasta que la tensión del RC supere el umbral
-    do
+    // Primera prueba: calibra el período del WDT contra el cristal
+    if (T_WDT == 0)
+        calibrar_wdt();
+
+    // Espera dormido hasta que la tensión del RC supere el umbral.
+    // Se lee AN9 una vez por despertar; si el próximo paso del RC cruzaría
+    // el umbral, se termina la espera despierto para no atrasar la prueba.
+    rc_anterior = 0;
+    while (1)
     {
-        leer_AD(9);  // AN9: tensión del capacitor RC
+        rc = leer_AD(9);  // AN9: tensión del capacitor RC
+        if (rc > UMBRAL_RC_PRUEBA)
+            break;
+        if (!AHORRO)
+            break;  // Bajo Consumo deshabilitado desde el panel
+
+        if ((uint16_t)rc + (uint8_t)(rc - rc_anterior) <= UMBRAL_RC_PRUEBA)
+        {
+            rc_anterior = rc;
+            dormir();
+        }
     }
-    while (ADRESH <= 140);
 
     encender();  // Vuelve a encender el puente H
 
@@ -393,6 +526,8 @@ inicio_prueba:
         apagar();
     }
 
+    reporte_sueno();  // Fracción dormida de esta prueba -> F_SUENO
+
     // Si se detectó carga suficiente -> salir de Bajo Consumo
     if (PREVIO & (1 << 6))
     {
@@ -412,11 +547,11 @@ inicio_prueba:
 }
 
 void temperat(void) {
+    TRAZA(TP_TEMPERAT);
+
     // Lectura de temperaturas
-    leer_AD(2);  // AN2 -> temperatura disipador
-    T_DISIP = ADRESH;
-    leer_AD(4);  // AN4 -> temperatura transformador
-    T_TRAFO = ADRESH;
+    T_DISIP = leer_AD(2);  // AN2 -> temperatura disipador
+    T_TRAFO = leer_AD(4);  // AN4 -> temperatura transformador
 
     // Control de temperatura del disipador
     if (PREVIO & (1 << 3))  // Puente apagado por disipador
@@ -530,56 +665,395 @@ void temperat(void) {
             SPI_SCK = 0;
         }
     }
+    TRAZA(TP_TEMPERAT_FIN);
+}
 
+// Antes de apagar(): causas del disparo en el registro de eventos
+void registrar_falla(void) {
+    uint8_t tipo = 0;
+
+    if (PREVIO & (1 << 1)) tipo |= EV_SOBRECORRIENTE;
+    if (PREVIO & (1 << 3)) tipo |= EV_DISIPADOR;
+    if (PREVIO & (1 << 5)) tipo |= EV_TRAFO;
+    if (ESTADO & (1 << 5)) tipo |= EV_BATERIA;
+    if (FALLA_ACTIVA || FALLA_HW == 0) tipo |= EV_FALLA_HW;
+    if (tipo)
+        registrar_evento(tipo);
 }
 
-void enviar(void) {
-    // Enviar V_SALIDA
-    PIR1bits.SSPIF = 0;  // Limpio flag SPI
-    SSPBUF = V_SALIDA;  // Cargo el byte a transmitir
+// Un byte de la trama. Con COMANDOS_SPI, lo que el display devolvió en el mismo
+// byte va al decodificador de comandos (SSPBUF se lee antes de limpiar SSPIF).
+static void enviar_byte(uint8_t dato) {
+    SSPBUF = dato;  // Cargo el byte a transmitir
     while (!PIR1bits.SSPIF);  // Espero fin de transmisión
+#if COMANDOS_SPI
+    recibir_comando(SSPBUF);
+#endif
     PIR1bits.SSPIF = 0;
+}
 
-    // Enviar I_SALIDA
-    SSPBUF = I_SALIDA;
-    while (!PIR1bits.SSPIF);
-    PIR1bits.SSPIF = 0;
+void enviar(void) {
+    uint8_t i;
+#if TRAZA_MODO == TRAZA_SPI
+    uint8_t n;
+#endif
+#if TRAZA_MODO == TRAZA_SPI || SINCRONISMO == SINC_ESCLAVO || MEDIR_ISR
+    uint8_t r[3];
+#endif
+#if COMANDOS_SPI
+    uint8_t volcado;
+#endif
+
+    TRAZA(TP_ENVIAR);
+
+    // RC3/RC4 son también las alarmas térmicas (SPI_SCK, SPI_SDI): el MSSP toma
+    // los pines solo durante la trama y al apagarlo vuelven a mostrar LATC
+#if COMANDOS_SPI
+    TRISCbits.TRISC4 = 1;   // SDI: el display manda los comandos
+#endif
+    SSPCON1bits.SSPEN = 1;
+    PIR1bits.SSPIF = 0;  // Limpio flag SPI
+#if RESUMEN
+    // Último resumen (RES_NUMERO no cambia si no hubo uno nuevo)
+    for (i = 0; i < RESUMEN_BYTES; i++)
+        enviar_byte(RES_TRAMA[i]);
+    RES_LISTO = 0;
+#else
+    enviar_byte(V_SALIDA);
+    enviar_byte(I_SALIDA);
+    enviar_byte(T_DISIP);   // Temperatura del disipador
+    enviar_byte(T_TRAFO);   // Temperatura del transformador
+    enviar_byte(ESTADO);    // Registro de estado
+    enviar_byte(F_SUENO);   // Fracción de tiempo dormido en Bajo Consumo
+    enviar_byte(THD_X10);   // THD de la salida (0,1 %, 0 sin THD_GOERTZEL)
+#endif
+
+    // Solo la primera trama: fases ya marcadas (bit por fase) y las marcas del
+    // arranque (Timer0, MSB primero; las fases sin marcar van en 0)
+    if (!ARR_ENVIADA)
+    {
+        enviar_byte(ARR_MARCAS);
+        for (i = 0; i < ARR_FASES; i++)
+        {
+            enviar_byte((uint8_t)(T_ARRANQUE[i] >> 8));
+            enviar_byte((uint8_t)T_ARRANQUE[i]);
+        }
+        ARR_ENVIADA = 1;
+    }
 
-    // Enviar temperatura del disipador
-    SSPBUF = T_DISIP;
-    while (!PIR1bits.SSPIF);
-    PIR1bits.SSPIF = 0;
+#if TRAZA_MODO == TRAZA_SPI
+    // Anillo de traza: cantidad, pisados y registros del más viejo al más nuevo.
+    // Lo que la ISR agregue mientras tanto sale en la trama siguiente.
+    INTCONbits.GIE = 0;
+    n = TRAZA_N;
+    r[0] = TRAZA_PERDIDOS;
+    TRAZA_PERDIDOS = 0;
+    INTCONbits.GIE = 1;
+    enviar_byte(n);
+    enviar_byte(r[0]);
+    while (n--)
+    {
+        INTCONbits.GIE = 0;
+        i = (TRAZA_ENTRA - TRAZA_N) & (TRAZA_REGISTROS - 1);
+        r[0] = TRAZA_BUF[i][0];
+        r[1] = TRAZA_BUF[i][1];
+        r[2] = TRAZA_BUF[i][2];
+        TRAZA_N--;
+        INTCONbits.GIE = 1;
+        for (i = 0; i < 3; i++)
+            enviar_byte(r[i]);
+    }
+#endif
+
+#if MEDIR_TAREAS
+    // Tiempos de una tarea por trama: número, ciclos desbordados, mínimo, máximo
+    // y las HIST_CUBETAS cuentas (16 bits, MSB primero). Solo main() los toca,
+    // así que no hace falta cortar las interrupciones.
+    enviar_byte(HIST_ENVIO);
+    enviar_byte(HOLGURA_CERO);
+    HOLGURA_CERO = 0;
+    for (i = 0; i < HIST_CUBETAS + 2; i++)
+    {
+        uint16_t w;
 
-    // Enviar temperatura del transformador
-    SSPBUF = T_TRAFO;
-    while (!PIR1bits.SSPIF);
-    PIR1bits.SSPIF = 0;
+        if (i == 0)
+            w = HIST_MIN[HIST_ENVIO];
+        else if (i == 1)
+            w = HIST_MAX[HIST_ENVIO];
+        else
+            w = HIST_CUENTAS[HIST_ENVIO][i - 2];
+        enviar_byte((uint8_t)(w >> 8));
+        enviar_byte((uint8_t)w);
+    }
+    borrar_tarea(HIST_ENVIO);
+    if (++HIST_ENVIO >= TAREAS)
+        HIST_ENVIO = 0;
+#endif
+
+#if MEDIR_ISR
+    // Peor duración de la ISR de Timer2 en Tcy (MSB primero; 256 o más: Timer2
+    // dio la vuelta y se perdió un tick)
+    PIE1bits.TMR2IE = 0;
+    i = (uint8_t)(ISR_TCY >> 8);
+    r[0] = (uint8_t)ISR_TCY;
+    PIE1bits.TMR2IE = 1;
+    enviar_byte(i);
+    enviar_byte(r[0]);
+#endif
+
+#if SINCRONISMO == SINC_ESCLAVO
+    // Fase respecto del maestro: último error en ticks (con signo, MSB primero) y
+    // ciclos seguidos dentro de SINC_BANDA. Los escribe la ISR de Timer2.
+    PIE1bits.TMR2IE = 0;
+    i = SINC_ENGANCHE;
+    r[0] = (uint8_t)((uint16_t)SINC_ERROR >> 8);
+    r[1] = (uint8_t)SINC_ERROR;
+    PIE1bits.TMR2IE = 1;
+    enviar_byte(r[0]);
+    enviar_byte(r[1]);
+    enviar_byte(i);
+#endif
+
+#if COMANDOS_SPI
+    // Respuesta a los comandos y, si se pidió, el próximo tramo del anillo de
+    // eventos de la EEPROM en el orden de las direcciones (registro.c ordena por
+    // secuencia). Con la ISR escribiendo, el tramo espera a la trama siguiente.
+    volcado = 0;
+    if (CMD_VOLCADO_POS < EV_REGISTROS && !eeprom_ocupada())
+        volcado = CMD_VOLCADO_TRAMA;
+    enviar_byte(CMD_APLICADOS);
+    enviar_byte(CMD_ERRORES);
+    enviar_byte(volcado);
+    if (volcado)
+    {
+        enviar_byte(CMD_VOLCADO_POS);
+        for (i = 0; i < CMD_VOLCADO_TRAMA * EV_BYTES; i++)
+            enviar_byte(leer_eeprom_en_marcha(EV_BASE + CMD_VOLCADO_POS * EV_BYTES + i));
+        CMD_VOLCADO_POS += CMD_VOLCADO_TRAMA;
+    }
+#endif
+    SSPCON1bits.SSPEN = 0;
+#if COMANDOS_SPI
+    TRISCbits.TRISC4 = 0;
+#endif
+    TRAZA(TP_ENVIAR_FIN);
+}
 
-    // Enviar registro de estado
-    SSPBUF = ESTADO;
-    while (!PIR1bits.SSPIF);
-    PIR1bits.SSPIF = 0;
+// --- COMANDOS POR SPI ---
+
+#if COMANDOS_SPI
+// Decodifica un byte recibido durante enviar(). Un comando completo y con la
+// suma bien entra en la cola; se aplica recién al empezar el ciclo siguiente.
+void recibir_comando(uint8_t dato) {
+    if (CMD_POS == 0)
+    {
+        if (dato == CMD_SINCRO)
+            CMD_POS = 1;
+        return;
+    }
+    if (CMD_POS < 4)
+    {
+        CMD_RX[CMD_POS++] = dato;
+        return;
+    }
+    CMD_POS = 0;
+    if ((uint8_t)~(CMD_RX[1] + CMD_RX[2] + CMD_RX[3]) != dato || CMD_N >= CMD_COLA)
+    {
+        CMD_ERRORES++;
+        return;
+    }
+    CMD_BUF[CMD_N][0] = CMD_RX[1];
+    CMD_BUF[CMD_N][1] = CMD_RX[2];
+    CMD_BUF[CMD_N][2] = CMD_RX[3];
+    CMD_N++;
+}
+
+// Al empezar el ciclo de 50 Hz, antes de cargar_v_pico() y pid(): todo el ciclo
+// corre con los valores nuevos
+void aplicar_comandos(void) {
+    uint8_t i;
+    uint8_t ok;
+
+    for (i = 0; i < CMD_N; i++)
+    {
+        ok = 1;
+        switch (CMD_BUF[i][0])
+        {
+        case CMD_REFERENCIA:
+            REF_REMOTA = (CMD_BUF[i][2] != 0);
+            if (REF_REMOTA)
+                REF_ERR = CMD_BUF[i][2];
+            break;
+        case CMD_PARAMETRO:
+            ok = escribir_parametro(CMD_BUF[i][1], CMD_BUF[i][2]);
+            break;
+        case CMD_GUARDAR:
+#if PARAMETROS_EEPROM
+            guardar_parametros();
+#else
+            ok = 0;
+#endif
+            break;
+        case CMD_VOLCADO:
+            CMD_VOLCADO_POS = 0;    // Vuelve a empezar si ya estaba en curso
+            break;
+        case CMD_PRUEBA:
+            CMD_PEDIDOS |= 1 << CMD_BUF[i][0];
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+        if (ok)
+            CMD_APLICADOS++;
+        else
+            CMD_ERRORES++;
+    }
+    CMD_N = 0;
+}
+#endif
+
+// --- RESUMEN ESTADÍSTICO ---
+
+#if RESUMEN
+// Bits de ESTADO que pasaron de 0 a 1 desde la última llamada. main() también la
+// llama antes de apagar(), para no perder las causas del disparo.
+void contar_estados(void) {
+    uint8_t nuevos;
+    uint8_t b;
+
+    nuevos = ESTADO & ~RES_ESTADO_ANT;
+    RES_ESTADO_ANT = ESTADO;
+    for (b = 0; nuevos; b++, nuevos >>= 1)
+        if ((nuevos & 1) && RES_ENTRADAS[b] < 255)
+            RES_ENTRADAS[b]++;
+}
+
+// Una vez por ciclo de 50 Hz, con las lecturas del ciclo ya hechas
+void acumular_resumen(void) {
+    uint8_t x[RES_VARIABLES];
+    uint8_t i, j;
+
+    x[0] = V_SALIDA; x[1] = I_SALIDA; x[2] = T_DISIP; x[3] = T_TRAFO;
+    for (i = 0; i < RES_VARIABLES; i++)
+    {
+        if (x[i] < RES_MIN[i])
+            RES_MIN[i] = x[i];
+        if (x[i] > RES_MAX[i])
+            RES_MAX[i] = x[i];
+        RES_SUMA[i] += x[i];
+    }
+    RES_CUENTAS[I_SALIDA >> RES_CUBETA_DESPL]++;
+    if (PREVIO & ((1 << 2) | (1 << 3)))
+        RES_SOBRE_DIS++;
+    if (PREVIO & ((1 << 4) | (1 << 5)))
+        RES_SOBRE_TRA++;
+    contar_estados();
+
+    if (++RES_CICLOS < (1UL << RESUMEN_LOG2))
+        return;
+
+    // Fin del intervalo: arma la trama y vuelve a empezar
+    j = 0;
+    RES_TRAMA[j++] = ++RES_NUMERO;
+    for (i = 0; i < RES_VARIABLES; i++)
+    {
+        RES_TRAMA[j++] = RES_MIN[i];
+        RES_TRAMA[j++] = RES_MAX[i];
+        RES_TRAMA[j++] = (uint8_t)(RES_SUMA[i] >> RESUMEN_LOG2);
+    }
+    for (i = 0; i < RES_CUBETAS; i++)
+    {
+        RES_TRAMA[j++] = (uint8_t)(RES_CUENTAS[i] >> 8);
+        RES_TRAMA[j++] = (uint8_t)RES_CUENTAS[i];
+    }
+    RES_TRAMA[j++] = (uint8_t)(RES_SOBRE_DIS >> 8);
+    RES_TRAMA[j++] = (uint8_t)RES_SOBRE_DIS;
+    RES_TRAMA[j++] = (uint8_t)(RES_SOBRE_TRA >> 8);
+    RES_TRAMA[j++] = (uint8_t)RES_SOBRE_TRA;
+    for (i = 0; i < 8; i++)
+        RES_TRAMA[j++] = RES_ENTRADAS[i];
+    RES_TRAMA[j++] = F_SUENO;
+    RES_TRAMA[j] = THD_X10;
+    RES_LISTO = 1;
+    borrar_resumen();
 }
 
+void borrar_resumen(void) {
+    uint8_t i;
+
+    for (i = 0; i < RES_VARIABLES; i++)
+    {
+        RES_MIN[i] = 255;
+        RES_MAX[i] = 0;
+        RES_SUMA[i] = 0;
+    }
+    for (i = 0; i < RES_CUBETAS; i++)
+        RES_CUENTAS[i] = 0;
+    for (i = 0; i < 8; i++)
+        RES_ENTRADAS[i] = 0;
+    RES_SOBRE_DIS = 0;
+    RES_SOBRE_TRA = 0;
+    RES_CICLOS = 0;
+}
+#endif
+
+// --- OPERACIÓN EN PARALELO ---
+
+#if PARALELO
+// Una vez por ciclo, después de pid(): caída de la referencia por lo que V_PICO
+// pasa de su valor en vacío, y atraso por tick según el ángulo medido en K = 1.
+// FASE_DIF mide el atraso del bus respecto de la tabla. Llevado a V_SALIDA = 128
+// el error de ganancia de AN0 no cambia el ángulo, y lo que el seno ya iba
+// atrasado (FASE_ATRASO, atrasar_seno()) no es potencia: 2 x 512 x cos(14,7°) x
+// pi / 98 = 31,7 por punto, ~atraso / 16 con el atraso en 1/256 de tick.
+// CAIDA_PASO es un byte: la ISR lo lee entero.
+void caida_paralelo(void) {
+    uint16_t v;
+    int32_t d;
+    uint8_t c;
+
+    v = ((uint16_t)V_PICO_0 << 8) | V_PICO_1;
+    v = (v > CAIDA_BASE) ? v - CAIDA_BASE : 0;
+    if (v > 255) v = 255;
+    c = (uint8_t)((v * CAIDA_V) >> 8);
+    REF_CAIDA = (REF_ERR > c) ? REF_ERR - c : 0;
+
+    if (!(AD_LISTO & AD_LISTO_FASE))
+        return;
+    AD_LISTO &= ~AD_LISTO_FASE;
+    if (V_SALIDA == 0)
+        return;
+    d = ((int32_t)FASE_DIF << 7) / V_SALIDA - (FASE_ATRASO >> 4);
+    if (d <= 0)
+        CAIDA_PASO = 0;
+    else
+    {
+        v = ((uint16_t)(d > 1000 ? 1000 : (uint16_t)d) * CAIDA_F) >> 4;
+        CAIDA_PASO = (v > 255) ? 255 : (uint8_t)v;
+    }
+}
+#endif
+
 // --- LÓGICA PID ---
 
 // [cite: 1162]
 void pid_1(void) {
-    if (V_SALIDA == REF_ERR)
+    if (V_SALIDA == REF_PID)
     {
         percent_err = 0;
-        pidStat1.err_sign = 1;
+        pidStat1 |= PID_ERR_SIGN;
         return;
     }
-    if (V_SALIDA > REF_ERR)
+    if (V_SALIDA > REF_PID)
     {
-        percent_err = V_SALIDA - REF_ERR;
-        pidStat1.err_sign = 0;  // error negativo
+        percent_err = V_SALIDA - REF_PID;
+        pidStat1 &= ~PID_ERR_SIGN;  // error negativo
     }
     else
     {
-        percent_err = REF_ERR - V_SALIDA;
-        pidStat1.err_sign = 1;  // error positivo
+        percent_err = REF_PID - V_SALIDA;
+        pidStat1 |= PID_ERR_SIGN;  // error positivo
     }
 
     // Saturación a 100
@@ -590,26 +1064,36 @@ void pid_1(void) {
 }
 
 void pid_2(void) {
+    uint16_t error;
+
     // Escalado del error: 0..100 -> 0..10000
     error = (uint16_t)U * (uint16_t)percent_err;
+    error0 = (uint8_t)(error >> 8);
+    error1 = (uint8_t)(error & 0xFF);
 
     // ¿Error nulo?
     if (error == 0)
     {
-        pidStat1.err_z = 1;
+        pidStat1 |= PID_ERR_Z;
         return;
     }
-    pidStat1.err_z = 0;
+    pidStat1 &= ~PID_ERR_Z;
 
+#if PID_VARIANTE >= PID_VAR_PI
     // Cálculo integral y derivativo
     PidInterrupt();
+#endif
 }
 
 //  Completada
 void pid_3(void) {
     Proportional(); // [cite: 1203]
+#if PID_VARIANTE >= PID_VAR_PI
     Integral();     // [cite: 1204]
+#endif
+#if PID_VARIANTE == PID_VAR_PID
     Derivative();   // [cite: 1205]
+#endif
 }
 
 // [cite: 1209] Implementación con GetPidResult
@@ -626,7 +1110,7 @@ void pid_4(void) {
     pid_out = ((int32_t)pidOut1 << 8) | pidOut2;
 
     // Suma o resta según signo del PID
-    if (pidStat1 & (1 << pid_sign))
+    if (pidStat1 & PID_SIGN)
     {
         result = ref + pid_out;
     }
@@ -636,10 +1120,593 @@ void pid_4(void) {
     }
 
     // Guardar resultado
-    TEMP0 = (uint8_t)(result >> 8);
+    TEMPO = (uint8_t)(result >> 8);
     TEMP1 = (uint8_t)(result & 0xFF);
 }
 
+// --- AUTOAJUSTE ---
+
+// Reglas de Ziegler-Nichols sobre Ku = 4d / (pi a), en Q8:
+// PI:  Kp = 0,45 Ku, Ti = Tu / 1,2      PID: Kp = 0,6 Ku, Ti = Tu / 2, Td = Tu / 8
+#define AUTO_KP_PI_Q8   147     // 0,45 x 4 / pi
+#define AUTO_KP_PID_Q8  196     // 0,60 x 4 / pi
+
+// Una ganancia calculada en 32 bits, o 0 si no entra en 1..255: saturada no es
+// una medición y la prueba se descarta
+static uint8_t ganancia_8(uint32_t g) {
+    if (g == 0 || g > 255)
+        return 0;
+    return (uint8_t)g;
+}
+
+// Prueba de relé en lazo abierto. Una vuelta por ciclo de 50 Hz, con la misma
+// secuencia que el bucle principal. El centro del relé arranca en REF0:REF1 y se
+// corre AUTO_D / 2 cada vez que la salida no cruza REF_ERR en AUTO_SIN_CRUCE
+// ciclos (con carga el punto de trabajo está por encima de REF).
+// Deja kp/ki/kd en la escala del PID: P = kp * e / S, I = ki * suma(e) / S,
+// D = kd * (e - e[-10]) / S con S = (U_0:U_1) / U, así que kp = S * Kp,
+// ki = kp / Ti y kd = kp * Td / 10 (Ti, Td en ciclos).
+// En cada ciclo corren las mismas protecciones que en el bucle principal
+// (corriente, temperatura y batería). Devuelve 1 con las ganancias medidas y 0 si
+// no las hay: una protección cortó la prueba, no hubo oscilación medible o alguna
+// ganancia no entra en 8 bits. Con 0 quedan las de inicializar_variables().
+uint8_t autoajuste(void) {
+    uint16_t centro = ((uint16_t)REF0 << 8) | REF1;
+    uint16_t v;
+    uint16_t n;
+    uint16_t suma_tu = 0;       // Ciclos de 50 Hz en AUTO_PERIODOS períodos
+    uint8_t ciclos = 0;         // Desde el último flanco de subida
+    uint8_t quieto = 0;         // Desde la última conmutación
+    uint8_t flancos = 0;
+    uint8_t alto = 1;
+    uint8_t v_min = 255;
+    uint8_t v_max = 0;
+    uint8_t pp;
+    uint8_t g_p, g_i, g_d;
+    uint32_t num;
+
+    for (n = 0; n < AUTO_CICLOS_MAX; n++)
+    {
+        if (FALLA_HW == 0 || FALLA_ACTIVA)
+            return 0;
+
+        MARCA_CICLO(1);
+        K &= 0x01;
+        MARCA_CICLO(0);
+
+        // Salida del relé
+        v = alto ? centro + AUTO_D : centro - AUTO_D;
+        V_PICO_0 = (uint8_t)(v >> 8);
+        V_PICO_1 = (uint8_t)(v & 0xFF);
+
+        V_SALIDA = leer_AD(0);
+        i_salida();
+        if (PREVIO & (1 << 1))
+            return 0;
+        temperat();
+        if ((PREVIO & (1 << 3)) || (PREVIO & (1 << 5)))
+            return 0;
+        if (V_BAT == 0)
+        {
+            ESTADO |= (1 << 5);
+            return 0;
+        }
+        ESTADO &= ~(1 << 5);
+
+        // Relé con histéresis; cada flanco de subida cierra un período
+        if (ciclos < 255)
+            ciclos++;
+        quieto++;
+        if (alto && V_SALIDA > REF_ERR + AUTO_HIST)
+        {
+            alto = 0;
+            quieto = 0;
+        }
+        else if (!alto && V_SALIDA < REF_ERR - AUTO_HIST)
+        {
+            alto = 1;
+            quieto = 0;
+            if (flancos > AUTO_DESCARTE)
+                suma_tu += ciclos;
+            if (flancos == AUTO_DESCARTE)
+            {
+                v_min = V_SALIDA;
+                v_max = V_SALIDA;
+            }
+            ciclos = 0;
+            if (++flancos > AUTO_DESCARTE + AUTO_PERIODOS)
+                break;
+        }
+        else if (quieto >= AUTO_SIN_CRUCE)
+        {
+            // Sin cruce: corre el centro y vuelve a empezar la medición
+            centro = alto ? centro + AUTO_D / 2 : centro - AUTO_D / 2;
+            quieto = 0;
+            flancos = 0;
+            suma_tu = 0;
+        }
+        if (flancos > AUTO_DESCARTE)
+        {
+            if (V_SALIDA < v_min) v_min = V_SALIDA;
+            if (V_SALIDA > v_max) v_max = V_SALIDA;
+        }
+
+        while (K < 2 && !FALLA_ACTIVA)
+        {
+            if (FALLA_HW == 0)
+                return 0;
+            ESPERA_TICK();
+        }
+    }
+
+    // El bucle principal arranca desde el punto de trabajo encontrado
+    TEMPO = (uint8_t)(centro >> 8);
+    TEMP1 = (uint8_t)(centro & 0xFF);
+
+    pp = v_max - v_min;
+    if (n >= AUTO_CICLOS_MAX || pp < 2 || suma_tu == 0)
+        return 0;
+
+    // kp = Q8 * S * d / a, con a = pp / 2
+    num = (uint32_t)(AUTO_CON_D ? AUTO_KP_PID_Q8 : AUTO_KP_PI_Q8) * AUTO_D * 2;
+    num *= ((uint16_t)U_0 << 8) | U_1;
+    g_p = ganancia_8(num / ((uint32_t)256 * U * pp));
+
+#if AUTO_CON_D
+    g_i = ganancia_8((uint32_t)g_p * 2 * AUTO_PERIODOS / suma_tu);
+    g_d = ganancia_8((uint32_t)g_p * suma_tu / (80 * AUTO_PERIODOS));
+#else
+    g_i = ganancia_8((uint32_t)g_p * 12 * AUTO_PERIODOS / (10 * (uint32_t)suma_tu));
+    g_d = 0;
+#endif
+    if (g_p == 0 || g_i == 0 || (AUTO_CON_D && g_d == 0))
+        return 0;
+
+    PidInitialize();    // Integrador limpio (también borra las ganancias)
+    kp = g_p;
+    ki = g_i;
+    kd = g_d;
+    kp_nom = g_p;
+    ki_nom = g_i;
+    kd_nom = g_d;
+    return 1;
+}
+
+// --- CONTROL REPETITIVO ---
+
+#if REPETITIVO
+// Se llama en la espera de fin de ciclo. Una vez por índice de SINE_TABLE lee AN0
+// (rectificada) y guarda el error contra V_SALIDA * seno. La referencia usa el pico
+// medido y no REF_ERR: la amplitud es del PID y la corrección solo ataca la forma
+// (si no, los dos integran el mismo error).
+// El error se promedia en REP_VENTANA índices centrados (filtro de fase nula,
+// anula la resonancia del LC) y corrige la entrada REP_ADELANTO puntos antes del
+// centro: C[k] += Kr * e[k + d], con olvido para no acumular ruido.
+// Ambos semiciclos comparten la tabla. La ISR solo lee CORRECCION[CICLO_0], que
+// va adelante del índice que se escribe.
+void repetitivo(void) {
+    uint8_t j = CICLO_0;
+    uint8_t k;
+    uint8_t i;
+    uint8_t m;
+    int16_t e;
+    int16_t c;
+
+    if (j == REP_INDICE)
+        return;
+    REP_INDICE = j;
+
+    m = leer_AD(0);
+    if (j == REP_INDICE_PICO)
+        V_SALIDA = m;
+
+    e = (int16_t)(((uint32_t)V_SALIDA * SINE_TABLE[j]) >> 14) - (int16_t)m;
+    if (e > 127) e = 127;
+    if (e < -127) e = -127;
+    ERROR_REP[j] = (int8_t)e;
+
+    // Promedio de ERROR_REP[j - VENTANA + 1 .. j]
+    e = 0;
+    k = j;
+    for (i = 0; i < REP_VENTANA; i++)
+    {
+        e += ERROR_REP[k];
+        k = (k == 0) ? PUNTOS_SENO - 1 : k - 1;
+    }
+    e /= REP_VENTANA;
+
+    // Entrada a corregir: centro de la ventana menos el adelanto
+    k = j + PUNTOS_SENO - REP_VENTANA / 2 - REP_ADELANTO;
+    if (k >= PUNTOS_SENO)
+        k -= PUNTOS_SENO;
+
+    c = CORRECCION[k];
+    c += e * REP_KR_Q4;
+    c -= c / (1 << REP_OLVIDO);
+    if (c > REP_LIMITE) c = REP_LIMITE;
+    if (c < -REP_LIMITE) c = -REP_LIMITE;
+    CORRECCION[k] = c;
+}
+#endif
+
+// Arranque: la corrección aprendida no vale para la rampa de encendido. V_SALIDA
+// parte de la referencia hasta la primera muestra en el pico (error nulo en el
+// primer pid()).
+void borrar_repetitivo(void) {
+#if REPETITIVO
+    uint8_t k;
+
+    V_SALIDA = REF_ERR;
+    for (k = 0; k < PUNTOS_SENO; k++)
+    {
+        CORRECCION[k] = 0;
+        ERROR_REP[k] = 0;
+    }
+    REP_INDICE = 0xFF;
+#endif
+}
+
+// --- PROGRAMACIÓN DE GANANCIAS ---
+
+#if PROGRAMA_GANANCIAS
+// Factores en Q6 (64 = 1,0) en I_SALIDA = 0, 64, 128, 192 y 256 (I_MAX = 242).
+// En vacío la salida sube sola al sacar carga: menos integral. Con carga pesada
+// la caída por la resistencia del puente y el trafo pide más integral.
+static const uint8_t FACTOR_KP[5] = { 56, 60, 64, 68, 72 };
+#if PID_VARIANTE >= PID_VAR_PI
+static const uint8_t FACTOR_KI[5] = { 48, 56, 64, 88, 112 };
+#endif
+#if PID_VARIANTE == PID_VAR_PID
+static const uint8_t FACTOR_KD[5] = { 64, 64, 64, 64, 64 };
+#endif
+
+// Interpola la tabla en I y aplica el factor a la ganancia nominal
+static uint8_t ganancia_programada(const uint8_t *tabla, uint8_t nominal, uint8_t i) {
+    uint8_t idx = i >> 6;
+    uint8_t frac = i & 0x3F;
+    int16_t f;
+    uint16_t g;
+
+    f = tabla[idx] + (((int16_t)tabla[idx + 1] - tabla[idx]) * frac >> 6);
+    g = ((uint16_t)nominal * (uint16_t)f) >> 6;
+    return (g > 255) ? 255 : (uint8_t)g;
+}
+#endif
+
+// Una vez por ciclo, después de i_salida(): filtra I_SALIDA y fija kp/ki/kd
+// para el pid() del ciclo siguiente
+void programar_ganancias(void) {
+#if PROGRAMA_GANANCIAS
+    uint16_t x = (uint16_t)I_SALIDA << 8;
+    uint8_t i;
+
+    if (x > I_FILT)
+        I_FILT += (x - I_FILT) >> FILTRO_I_SALIDA;
+    else
+        I_FILT -= (I_FILT - x) >> FILTRO_I_SALIDA;
+    i = (uint8_t)(I_FILT >> 8);
+
+    kp = ganancia_programada(FACTOR_KP, kp_nom, i);
+#if PID_VARIANTE >= PID_VAR_PI
+    ki = ganancia_programada(FACTOR_KI, ki_nom, i);
+#endif
+#if PID_VARIANTE == PID_VAR_PID
+    kd = ganancia_programada(FACTOR_KD, kd_nom, i);
+#endif
+#endif
+}
+
+// --- COMPENSACIÓN DE TIEMPO MUERTO ---
+
+#if COMPENSA_TM
+// Adelanto de la corriente del puente sobre la tensión, en índices de SINE_TABLE
+// (98 = 180°), por cada 16 cuentas de I_SALIDA: atan(Ic / I) con la corriente
+// del capacitor del filtro Ic = 27 cuentas (10 uF a 325 V pico, 1 A).
+static const uint8_t ADELANTO_TM[16] = {
+    40, 26, 19, 14, 11, 9, 8, 7, 6, 5, 5, 5, 4, 4, 4, 3
+};
+// Corriente pico del puente sobre su rizado (~1 A = 26 cuentas), Q4: sqrt(I^2 + Ic^2) / 26
+static const uint8_t PENDIENTE_TM[16] = {
+    17, 22, 29, 38, 47, 56, 66, 75, 85, 94, 104, 114, 123, 133, 143, 152
+};
+#endif
+
+// Una vez por ciclo, después de i_salida(): fase y pendiente de la corriente para ccpr1()
+void compensar_tm(void) {
+#if COMPENSA_TM
+    TM_ADELANTO = ADELANTO_TM[I_SALIDA >> 4];
+    TM_PENDIENTE = PENDIENTE_TM[I_SALIDA >> 4];
+#endif
+}
+
+// --- OBSERVADOR DE CARGA ---
+
+// Una vez por ciclo, después de i_salida(): OBS_V = K x (I_SALIDA - I en vacío).
+// Si I_SALIDA cambió más de OBS_ESCALON corrige también el V_PICO del ciclo en curso.
+void observador_carga(void) {
+#if OBSERVADOR_CARGA
+    int16_t di = (int16_t)I_SALIDA - (int16_t)OBS_I_ANT;
+    int16_t p;
+    int16_t v;
+
+    // En sobrecorriente (PP > 0) la carga no es lineal (arranque de motor,
+    // cortocircuito) y subir la tensión la empeora: se retira la predicción hasta
+    // que PP vuelve a 0. La referencia es fija, así que no hay nada que volver a medir.
+    if (PP != 0)
+    {
+        OBS_V = 0;
+        OBS_SIN_REF = 1;
+        return;
+    }
+
+    // Predicción desde la lectura en vacío, sin memoria: cualquier secuencia de
+    // escalones termina en el mismo OBS_V para la misma carga
+    p = (int16_t)(((int32_t)((int16_t)I_SALIDA - OBS_I_VACIO) * OBS_K_Q8) >> 8);
+    if (p > OBS_MAXIMO) p = OBS_MAXIMO;
+    if (p < -OBS_MAXIMO) p = -OBS_MAXIMO;
+
+    // Al encender o al salir de PP el integrador ya cubre la carga que hay (no se
+    // borra al apagar y en PP trabajó solo): OBS_V entra de a OBS_RAMPA por ciclo
+    // para que se descargue sin que los dos la sumen, y sin medir escalones.
+    OBS_I_ANT = I_SALIDA;
+    if (OBS_SIN_REF)
+    {
+        di = 0;
+        if (p > OBS_V + OBS_RAMPA) p = OBS_V + OBS_RAMPA;
+        else if (p < OBS_V - OBS_RAMPA) p = OBS_V - OBS_RAMPA;
+        else OBS_SIN_REF = 0;
+    }
+    v = p - OBS_V;
+    OBS_V = (int8_t)p;
+
+    if (di >= OBS_ESCALON || di <= -OBS_ESCALON)
+    {
+        // V_PICO tiene dos bytes: sin la ISR de Timer2 mientras cambia
+        v += (int16_t)(((uint16_t)V_PICO_0 << 8) | V_PICO_1);
+        if (v < 0) v = 0;
+        if (v > 1023) v = 1023;
+        PIE1bits.TMR2IE = 0;
+        V_PICO_0 = (uint8_t)(v >> 8);
+        V_PICO_1 = (uint8_t)(v & 0xFF);
+        PIE1bits.TMR2IE = 1;
+    }
+#endif
+}
+
+// Al encender: la predicción vuelve a entrar en rampa desde 0
+void borrar_observador(void) {
+    OBS_V = 0;
+    OBS_SIN_REF = 1;
+}
+
+// --- PREALIMENTACIÓN DE BATERÍA ---
+
+#if PREALIM_VBAT
+// VBAT_NOM / V_BAT en Q8 desde 16 V (128 cuentas) de a 2 cuentas (0,25 V).
+// Debajo de 16 V queda en 1,5: la protección de batería corta antes.
+static const uint16_t RECIPROCO_VBAT[64] = {
+    381, 375, 370, 364, 359, 354, 349, 344, 339, 334, 330, 326, 321, 317, 313, 309,
+    305, 302, 298, 294, 291, 287, 284, 281, 278, 275, 272, 269, 266, 263, 260, 257,
+    255, 252, 250, 247, 245, 242, 240, 237, 235, 233, 231, 229, 227, 224, 222, 220,
+    218, 217, 215, 213, 211, 209, 207, 206, 204, 202, 201, 199, 197, 196, 194, 193
+};
+
+// En la espera del fin de ciclo: una lectura por ciclo en VBAT_INDICE. La
+// corriente de batería va como sen^2, así que a 135° la caída en la resistencia
+// interna es la media del ciclo (en el cruce por cero se leería la batería en vacío).
+void medir_vbat(void) {
+    if (K == 0)
+    {
+        VBAT_LEIDA = 0;
+        return;
+    }
+    if (VBAT_LEIDA || K != 1 || CICLO_0 < VBAT_INDICE)
+        return;
+    VBAT_AD = leer_AD(CANAL_VBAT);
+    VBAT_LEIDA = 1;
+}
+
+// VBAT_NOM / V_BAT en Q8 con la última lectura
+static uint16_t factor_vbat(void) {
+    uint8_t v = (VBAT_AD < 128) ? 0 : (uint8_t)((VBAT_AD - 128) >> 1);
+    uint16_t f = RECIPROCO_VBAT[v];
+
+    // En sobrecorriente la batería cae por la misma carga que hay que limitar:
+    // no se compensa hacia arriba (arranque de motor, cortocircuito)
+    if (PP != 0 && f > 256)
+        f = 256;
+    return f;
+}
+#endif
+
+// V_PICO desde la salida del PID (TEMPO:TEMP1), con la prealimentación de batería
+// y la predicción por carga. Con la ISR de Timer2 enmascarada: fuera del inicio
+// del ciclo V_PICO cambia mientras se genera.
+void cargar_v_pico(void) {
+    uint32_t v = ((uint16_t)TEMPO << 8) | TEMP1;
+
+#if PREALIM_VBAT
+    v = (v * factor_vbat()) >> 8;   // V_PICO = TEMPO:TEMP1 x VBAT_NOM / V_BAT
+#endif
+#if OBSERVADOR_CARGA
+    if (OBS_V < 0 && v < (uint8_t)-OBS_V)
+        v = 0;
+    else
+        v += OBS_V;
+#endif
+    if (v > 1023) v = 1023;
+
+    PIE1bits.TMR2IE = 0;
+    V_PICO_0 = (uint8_t)(v >> 8);
+    V_PICO_1 = (uint8_t)(v & 0xFF);
+    PIE1bits.TMR2IE = 1;
+}
+
+// --- ESTIMADOR DE THD ---
+
+#if THD_GOERTZEL
+// 2 cos(w) y sen(w) en Q14 para w = 2 pi k / 28, k = 1, 3, ..., 13
+static const int16_t THD_COS2[7] = { 31946, 25619, 14218, 0, -14218, -25619, -31946 };
+static const int16_t THD_SEN[7] = { 3646, 10215, 14761, 16384, 14761, 10215, 3646 };
+
+// num / den en Q24 por división con restos (den < 2^31)
+static uint32_t razon_q24(uint32_t num, uint32_t den) {
+    uint32_t q = 0;
+    uint8_t i;
+
+    if (num >= den)
+        return 0xFFFFFF;
+    for (i = 0; i < 24; i++)
+    {
+        num <<= 1;
+        q <<= 1;
+        if (num >= den)
+        {
+            num -= den;
+            q |= 1;
+        }
+    }
+    return q;
+}
+
+// Raíz cuadrada entera de 32 bits (bit a bit)
+static uint16_t raiz_32(uint32_t x) {
+    uint32_t r = 0;
+    uint32_t b = (uint32_t)1 << 30;
+
+    while (b > x)
+        b >>= 2;
+    while (b)
+    {
+        if (x >= r + b)
+        {
+            x -= r + b;
+            r = (r >> 1) + b;
+        }
+        else
+            r >>= 1;
+        b >>= 2;
+    }
+    return (uint16_t)r;
+}
+
+// Cierre del bloque: |X|^2 = re^2 + im^2 con re = s1 - cos(w) s2, im = sen(w) s2,
+// y THD = raíz(suma de armónicos / fundamental)
+static void calcular_thd(void) {
+    uint32_t p1 = 0;
+    uint32_t ph = 0;
+    uint32_t p;
+    uint32_t t;
+    int32_t re;
+    int32_t im;
+    uint8_t b;
+
+    for (b = 0; b < THD_BINS; b++)
+    {
+        re = THD_S1[b] - (((int32_t)THD_COS2[b] * THD_S2[b]) >> 15);
+        im = ((int32_t)THD_SEN[b] * THD_S2[b]) >> 14;
+        p = (uint32_t)(re * re) + (uint32_t)(im * im);
+        if (b == 0)
+            p1 = p;
+        else
+            ph += p;
+    }
+
+    if (p1 == 0)
+        THD_X10 = 0;
+    else
+    {
+        // THD en Q12 (4096 = 100 %) a 0,1 %
+        t = ((uint32_t)raiz_32(razon_q24(ph, p1)) * 1000 + 2048) >> 12;
+        THD_X10 = (t > 255) ? 255 : (uint8_t)t;
+    }
+    borrar_thd();
+}
+#endif
+
+// En la espera del fin de ciclo: en K = 1 lee AN0 en los índices THD_FASE + 7 j y
+// avanza los resonadores (s = x + 2 cos(w) s1 - s2); en K = 0, con el bucle
+// libre, cierra el bloque si está completo
+void medir_thd(void) {
+#if THD_GOERTZEL
+    int16_t x;
+    int32_t s;
+    uint8_t b;
+
+    if (K == 0)
+    {
+        if (THD_FIN)
+            calcular_thd();
+        THD_J = 0;
+        return;
+    }
+    if (K != 1 || THD_J >= PUNTOS_SENO / THD_PASO || THD_FIN)
+        return;
+    if (CICLO_0 < THD_FASE + THD_J * THD_PASO)
+        return;
+    if (CICLO_0 != THD_FASE + THD_J * THD_PASO)
+    {
+        // Muestra perdida: el bloque ya no es una senoidal muestreada
+        borrar_thd();
+        THD_J = PUNTOS_SENO / THD_PASO;
+        return;
+    }
+    THD_J++;
+
+    x = leer_AD(0);
+    if (THD_N & 1)
+        x = -x;
+    for (b = 0; b < THD_BINS; b++)
+    {
+        s = x + (((int32_t)THD_COS2[b] * THD_S1[b]) >> 14) - THD_S2[b];
+        THD_S2[b] = THD_S1[b];
+        THD_S1[b] = s;
+    }
+
+    if (THD_J == PUNTOS_SENO / THD_PASO && ++THD_N == THD_CICLOS)
+        THD_FIN = 1;
+#endif
+}
+
+// Arranque y fin de bloque: resonadores en cero (THD_X10 queda con el último valor)
+void borrar_thd(void) {
+#if THD_GOERTZEL
+    uint8_t b;
+
+    for (b = 0; b < THD_BINS; b++)
+    {
+        THD_S1[b] = 0;
+        THD_S2[b] = 0;
+    }
+    THD_N = 0;
+    THD_FIN = 0;
+#endif
+}
+
+// --- PID MULTITASA ---
+
+// Desde la espera del fin de ciclo: la actualización número PID_TRAMO corre cuando
+// el tick dentro del ciclo pasa PID_TRAMO x PID_TICKS, con la muestra de AN0 de
+// ese momento, y su salida se aplica en el acto
+void pid_intermedio(void) {
+#if PID_POR_CICLO > 1
+    uint16_t t;
+
+    if (K >= 2 || PID_TRAMO >= PID_POR_CICLO)
+        return;
+    t = ((uint16_t)(K * PUNTOS_SENO + CICLO_0) << 1) + NN - 1;
+    if (t < (uint16_t)PID_TRAMO * PID_TICKS)
+        return;
+    PID_TRAMO++;
+
+#if !REPETITIVO
+    V_SALIDA = leer_AD(0);
+#endif
+    pid();
+    cargar_v_pico();
+#endif
+}
+
 void PidInitialize(void) {
     // Limpieza de errores
     error0 = 0;
@@ -682,14 +1749,14 @@ void PidInitialize(void) {
     BARGB2 = 0;
 
     // Inicialización del contador derivativo
-    derivCount = derivCountVal;  // derivCountVal = 0.10 (según comentario)
+    derivCount = derivCountRecarga;  // derivCountVal = 10 ciclos
 
     // Inicialización de banderas
-    pidStat1.err_z = 0;  // error distinto de cero
-    pidStat1.a_err_z = 1;  // error acumulado = 0
-    pidStat2.d_err_z = 1;  // error derivativo = 0
-    pidStat1.p_err_sign = 1;  // error previo positivo
-    pidStat1.a_err_sign = 1;  // error acumulado positivo
+    pidStat1 &= ~PID_ERR_Z;  // error distinto de cero
+    pidStat1 |= PID_A_ERR_Z;  // error acumulado = 0
+    pidStat2 |= PID2_D_ERR_Z;  // error derivativo = 0
+    pidStat1 |= PID_P_ERR_SIGN;  // error previo positivo
+    pidStat1 |= PID_A_ERR_SIGN;  // error acumulado positivo
 }
 
 void Proportional(void) {
@@ -707,9 +1774,10 @@ void Proportional(void) {
     prop2 = AARGB3;
 }
 
+#if PID_VARIANTE >= PID_VAR_PI
 void Integral(void) {
     // ¿Error acumulado = 0?
-    if (pidStat1.a_err_z)
+    if (pidStat1 & PID_A_ERR_Z)
         goto integral_zero;
 
     // Preparar multiplicación
@@ -726,29 +1794,17 @@ void Integral(void) {
     integ1 = AARGB3;
     integ2 = AARGB4;
     return;
-
-    // Código legado
-    AARGB0 = integ0;
-    AARGB1 = integ1;
-    AARGB2 = integ2;
-    AARGB3 = 0;
-    AARGB4 = 0;
-    BARGB0 = 0;
-    BARGB1 = 10;
-    FXD2416U();
-    integ0 = AARGB0;
-    integ1 = AARGB1;
-    integ2 = AARGB2;
-    return;
 integral_zero:
     integ0 = 0;
     integ1 = 0;
     integ2 = 0;
 }
+#endif
 
+#if PID_VARIANTE == PID_VAR_PID
 void Derivative(void) {
     // ¿Delta de error = 0?
-    if (pidStat2.d_err_z)
+    if (pidStat2 & PID2_D_ERR_Z)
         goto derivative_zero;
 
     // Preparar multiplicación
@@ -769,43 +1825,55 @@ derivative_zero:
     deriv1 = 0;
     deriv2 = 0;
 }
+#endif
 
 // [cite: 1354]
 void GetPidResult(void) {
+#if PID_VARIANTE == PID_VAR_PID
+    uint8_t tempReg;
+#endif
+
     // Cargar Prop en AARGB
     AARGB0 = prop0;
     AARGB1 = prop1;
     AARGB2 = prop2;
 
+#if PID_VARIANTE == PID_VAR_P
+    // Solo proporcional: el signo es el del error
+    pidStat1 &= ~PID_SIGN;
+    if (pidStat1 & PID_ERR_SIGN)
+        pidStat1 |= PID_SIGN;
+#else
     // Cargar Integ en BARGB
     BARGB0 = integ0;
     BARGB1 = integ1;
     BARGB2 = integ2;
 
-    pidStat2.selecinteg = 0;  // SpecSign trabaja con pid_sign
+    pidStat2 &= ~PID2_SELECINTEG;  // SpecSign trabaja con pid_sign
 
     SpecSign();  // Suma P + I
 
-    // ¿Signo = 0?
-    if (pidStat2.signo == 0)
+    // Mismo signo: SpecSign ya lo dejó en PID_SIGN
+    if (pidStat2 & PID2_SIGNO)
         goto add_derivative;
 
-    // Determinar magnitud
-    if (pidStat1.mag == 0)
+    // Signos distintos: manda el de mayor magnitud
+    if ((pidStat1 & PID_MAG) == 0)
         goto integ_mag;
     else
         goto prop_mag;
 
 integ_mag:
-    pidStat1.pid_sign = 0;
-    if (pidStat1.a_err_sign)
-        pidStat1.pid_sign = 1;
+    pidStat1 &= ~PID_SIGN;
+    if (pidStat1 & PID_A_ERR_SIGN)
+        pidStat1 |= PID_SIGN;
     goto add_derivative;
 prop_mag:
-    pidStat1.pid_sign = 0;
-    if (pidStat1.err_sign)
-        pidStat1.pid_sign = 1;
+    pidStat1 &= ~PID_SIGN;
+    if (pidStat1 & PID_ERR_SIGN)
+        pidStat1 |= PID_SIGN;
 add_derivative:
+#if PID_VARIANTE == PID_VAR_PID
     // Cargar Derivativo
     BARGB0 = deriv0;
     BARGB1 = deriv1;
@@ -826,24 +1894,26 @@ add_derivative:
 
     MagAndSub();  // Signos distintos
 
-    if (pidStat1.mag == 0)
+    if ((pidStat1 & PID_MAG) == 0)
         goto deriv_mag;
     goto scale_down;
 
 deriv_mag:
-    pidStat1.pid_sign = 0;
-    if (pidStat1.d_err_sign)
-        pidStat1.pid_sign = 1;
+    pidStat1 &= ~PID_SIGN;
+    if (pidStat1 & PID_D_ERR_SIGN)
+        pidStat1 |= PID_SIGN;
 scale_down:
+#endif
+#endif
     // División final
     BARGB0 = U_0;
     BARGB1 = U_1;
 
     FXD2416U();
 
-    // Saturación a 340 (0x0154)
-    if ((AARGB2 > 0x54) ||
-        (AARGB2 == 0x54 && AARGB1 >= 0x01))
+    // Saturación a 340 (0x0154), resultado en AARGB0:AARGB1:AARGB2
+    if ((AARGB0 != 0) || (AARGB1 > 0x01) ||
+        (AARGB1 == 0x01 && AARGB2 >= 0x54))
     {
         pidOut2 = 0x54;
         pidOut1 = 0x01;
@@ -908,27 +1978,38 @@ void _24_BitAdd(void) {
     AARGB2 = (uint8_t)(res & 0xFF);
 }
 
+void _24_bit_sub(void) {
+    // Resta AARGB - BARGB -> AARGB (AARGB >= BARGB)
+    uint32_t a = ((uint32_t)AARGB0 << 16) | ((uint16_t)AARGB1 << 8) | AARGB2;
+    uint32_t b = ((uint32_t)BARGB0 << 16) | ((uint16_t)BARGB1 << 8) | BARGB2;
+    uint32_t res = a - b;
+
+    AARGB0 = (uint8_t)(res >> 16);
+    AARGB1 = (uint8_t)(res >> 8);
+    AARGB2 = (uint8_t)(res & 0xFF);
+}
+
 void MagAndSub(void) {
     // Comparación de magnitudes (24 bits)
-    if (AARGB[0] > BARGB[0] ||
-       (AARGB[0] == BARGB[0] && AARGB[1] > BARGB[1]) ||
-       (AARGB[0] == BARGB[0] && AARGB[1] == BARGB[1] && AARGB[2] >= BARGB[2]))
+    if (AARGB0 > BARGB0 ||
+       (AARGB0 == BARGB0 && AARGB1 > BARGB1) ||
+       (AARGB0 == BARGB0 && AARGB1 == BARGB1 && AARGB2 >= BARGB2))
     {
         // AARGB >= BARGB
         _24_bit_sub();  // AARGB = AARGB - BARGB
-        pidStat1_mag = 1;  // AARGB mayor
+        pidStat1 |= PID_MAG;  // AARGB mayor
     }
     else
     {
         // BARGB > AARGB -> swap
         uint8_t temp;
 
-        temp = AARGB[0]; AARGB[0] = BARGB[0]; BARGB[0] = temp;
-        temp = AARGB[1]; AARGB[1] = BARGB[1]; BARGB[1] = temp;
-        temp = AARGB[2]; AARGB[2] = BARGB[2]; BARGB[2] = temp;
+        temp = AARGB0; AARGB0 = BARGB0; BARGB0 = temp;
+        temp = AARGB1; AARGB1 = BARGB1; BARGB1 = temp;
+        temp = AARGB2; AARGB2 = BARGB2; BARGB2 = temp;
 
         _24_bit_sub();  // AARGB = BARGB - AARGB
-        pidStat1_mag = 0;  // BARGB mayor
+        pidStat1 &= ~PID_MAG;  // BARGB mayor
     }
 }
 
@@ -936,45 +2017,142 @@ void SpecSign(void) {
     uint8_t signBits;
 
     // Set signo flag
-    pidStat2.signo = 1;
+    pidStat2 |= PID2_SIGNO;
 
     // Leer bits 3 y 2 (error y a_error)
     signBits = pidStat1 & 0x0C;
     if (signBits == 0x00)  // ambos negativos
     {
         _24_BitAdd();  // sumar
-        if (!pidStat2.selecinteg)
-            pidStat1.pid_sign = 0;
+        if (!(pidStat2 & PID2_SELECINTEG))
+            pidStat1 &= ~PID_SIGN;
         else
-            pidStat1.a_err_sign = 0;
+            pidStat1 &= ~PID_A_ERR_SIGN;
     }
     else if (signBits == 0x0C)  // ambos positivos
     {
         _24_BitAdd();  // sumar
-        if (!pidStat2.selecinteg)
-            pidStat1.pid_sign = 1;
+        if (!(pidStat2 & PID2_SELECINTEG))
+            pidStat1 |= PID_SIGN;
         else
-            pidStat1.a_err_sign = 1;
+            pidStat1 |= PID_A_ERR_SIGN;
     }
     else  // signos distintos
     {
-        pidStat2.signo = 0;
+        pidStat2 &= ~PID2_SIGNO;
         MagAndSub();  // restar
     }
 }
 
+#if PID_VARIANTE >= PID_VAR_PI
 void PidInterrupt(void) {
-        // Si el error es cero, no se calcula nada
-    if (pidStat1_err_z)
+    // Si el error es cero, no se calcula nada
+    if (pidStat1 & PID_ERR_Z)
         return;
 
     // Actualiza el término integral (a_Error)
     GetA_Error();
 
+#if PID_VARIANTE == PID_VAR_PID
     // ¿Es momento de calcular la derivada?
     if (--derivCount == 0)
     {
         DeltaError();  // d_Error = error - p_error
-        derivCount = derivCountVal;  // recarga contador
+        derivCount = derivCountRecarga;  // recarga contador
+    }
+#endif
+}
+
+void GetA_Error(void) {
+    // a_Error = a_Error + error (con signo)
+    AARGB0 = a_Error0;
+    AARGB1 = a_Error1;
+    AARGB2 = a_Error2;
+    BARGB0 = 0;
+#if PID_POR_CICLO > 1
+    // Con varias actualizaciones por ciclo cada una suma error / PID_POR_CICLO:
+    // la integral crece por unidad de tiempo igual que con una sola
+    {
+        uint16_t e = (((uint16_t)error0 << 8) | error1) / PID_POR_CICLO;
+        BARGB1 = (uint8_t)(e >> 8);
+        BARGB2 = (uint8_t)(e & 0xFF);
     }
+#else
+    BARGB1 = error0;
+    BARGB2 = error1;
+#endif
+
+    pidStat2 |= PID2_SELECINTEG;  // SpecSign trabaja con a_err_sign
+    SpecSign();
+
+    // Signos distintos: el signo resultante es el del mayor
+    if ((pidStat2 & PID2_SIGNO) == 0)
+    {
+        if ((pidStat1 & PID_MAG) == 0)
+        {
+            pidStat1 &= ~PID_A_ERR_SIGN;
+            if (pidStat1 & PID_ERR_SIGN)
+                pidStat1 |= PID_A_ERR_SIGN;
+        }
+    }
+
+    // Límite anti-windup del error acumulado
+    if ((AARGB0 != 0) || (AARGB1 > A_ERR_LIM_H) ||
+        (AARGB1 == A_ERR_LIM_H && AARGB2 > A_ERR_LIM_L))
+    {
+        AARGB0 = 0;
+        AARGB1 = A_ERR_LIM_H;
+        AARGB2 = A_ERR_LIM_L;
+    }
+
+    a_Error0 = AARGB0;
+    a_Error1 = AARGB1;
+    a_Error2 = AARGB2;
+
+    // ¿Error acumulado = 0?
+    if ((a_Error0 | a_Error1 | a_Error2) == 0)
+        pidStat1 |= PID_A_ERR_Z;
+    else
+        pidStat1 &= ~PID_A_ERR_Z;
+}
+#endif
+
+#if PID_VARIANTE == PID_VAR_PID
+void DeltaError(void) {
+    int32_t e;
+    int32_t p;
+    int32_t d;
+
+    // Error actual y previo con signo
+    e = ((int32_t)error0 << 8) | error1;
+    if (!(pidStat1 & PID_ERR_SIGN))
+        e = -e;
+    p = ((int32_t)p_Error0 << 8) | p_Error1;
+    if (!(pidStat1 & PID_P_ERR_SIGN))
+        p = -p;
+
+    // d_Error = error - p_Error (magnitud + signo)
+    d = e - p;
+    pidStat1 &= ~PID_D_ERR_SIGN;
+    if (d >= 0)
+        pidStat1 |= PID_D_ERR_SIGN;
+    else
+        d = -d;
+    if (d > 0xFFFF)
+        d = 0xFFFF;
+    d_Error0 = (uint8_t)(d >> 8);
+    d_Error1 = (uint8_t)(d & 0xFF);
+
+    if (d == 0)
+        pidStat2 |= PID2_D_ERR_Z;
+    else
+        pidStat2 &= ~PID2_D_ERR_Z;
+
+    // El error actual pasa a ser el previo
+    p_Error0 = error0;
+    p_Error1 = error1;
+    pidStat1 &= ~PID_P_ERR_SIGN;
+    if (pidStat1 & PID_ERR_SIGN)
+        pidStat1 |= PID_P_ERR_SIGN;
 }
+#endif
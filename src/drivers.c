@@ -10,17 +10,38 @@
 
 #define _XTAL_FREQ 20000000UL // [cite: 591] Requerido para _delay_us
 
+// Primera inicialización: Timer0 libre de 16 bits (Fosc/4, 1:256 -> 51,2 us por
+// tick) para medir tiempos; desde acá cuentan las marcas del arranque
+void inicializar_timer0(void) {
+    uint8_t i;
+
+    T0CON = 0b10000111;
+    TMR0H = 0;
+    TMR0L = 0;
+    INTCONbits.TMR0IE = 0;
+
+    for (i = 0; i < ARR_FASES; i++)
+        T_ARRANQUE[i] = 0;
+    ARR_MARCAS = 0;
+    ARR_ENVIADA = 0;
+}
+
 // [cite: 297]
 void inicializar_pines(void) {
     // ENTRADAS [cite: 300]
     TRISAbits.TRISA4 = 1; // V_BAT
-    TRISBbits.TRISB0 = 1; // AHORRO
+    TRISBbits.TRISB0 = 1; // FALLA_HW (INT0)
+    TRISCbits.TRISC6 = 1; // AHORRO
 
     // SALIDAS [cite: 302-306]
     TRISBbits.TRISB4 = 0; // AIRE
     TRISBbits.TRISB5 = 0; // BUZZER
     TRISBbits.TRISB6 = 0; // LECTURA
+#if SINCRONISMO == SINC_ESCLAVO
+    TRISBbits.TRISB7 = 1; // SYNC_ENTRADA (pulso del maestro)
+#else
     TRISBbits.TRISB7 = 0; // SYNC_OSC
+#endif
     TRISCbits.TRISC3 = 0; // SPI_SCK
     TRISCbits.TRISC4 = 0; // SPI_SDI
     TRISCbits.TRISC5 = 0; // SPI_SDO
@@ -39,27 +60,49 @@ void inicializar_pines(void) {
 void inicializar_puertos(void) {
     TRISA = 0b00111111; // RA0..RA5 entradas [cite: 320]
     LATA = 0x00;
-    TRISB = 0b00001101; // RB0, RB2, RB3 entradas [cite: 323]
+#if SINCRONISMO == SINC_ESCLAVO
+    TRISB = 0b10001101; // RB0 (FALLA_HW), RB2, RB3 y RB7 (SYNC_ENTRADA) entradas
+#else
+    TRISB = 0b00001101; // RB0 (FALLA_HW), RB2, RB3 entradas [cite: 323]
+#endif
     LATB = 0x00;
-    TRISC = 0b01000000; // RC6 entrada [cite: 329]
+    TRISC = 0b01000000; // RC6 entrada (AHORRO) [cite: 329]
     LATC = 0x00;
 }
 
 // [cite: 331]
 void inicializar_adc(void) {
+#if PREALIM_VBAT
+    // AN0 hasta CANAL_VBAT analógicos: PCFG = 0100 (AN10) o 0011 (AN11). Solo en el
+    // simulador: en esta placa esos pines son salidas (ver opciones.h)
+    ADCON1 = 14 - CANAL_VBAT;
+#else
     // AN0-AN4, AN8, AN9 analógicos
     ADCON1 = 0b00000101; // [cite: 334]
+#endif
+#if AD_SINCRONO
+    // Tacq automática de 4 TAD (3,2 us) al poner GO: la ISR arranca la conversión
+    // sin esperar la adquisición (muestrear_ad())
+    ADCON2 = 0b00010101; // Justificación izq, Fosc/16, Tacq = 4 TAD
+#else
     ADCON2 = 0b00000101; // Justificación izq, Fosc/16, Tacq manual [cite: 338]
+#endif
 }
 
 // [cite: 340]
 void inicializar_interrupciones(void) {
     RCONbits.IPEN = 0;      // Deshabilito prioridades
+    PIR1 = 0x00;
+    PIR2 = 0x00;
+
+    // Falla de hardware: flanco descendente del FF de protección en RB0/INT0
+    INTCON2bits.INTEDG0 = 0;
+    INTCONbits.INT0IF = 0;
+    INTCONbits.INT0IE = 1;
+
     INTCONbits.GIE = 1;     // Habilitación global
     INTCONbits.PEIE = 1;
     PIE1bits.TMR2IE = 1;    // Interrupción Timer2
-    PIR1 = 0x00;
-    PIR2 = 0x00;
 }
 
 // [cite: 350]
@@ -77,6 +120,18 @@ void inicializar_pwm_timer2(void) {
     CCP2CON = 0b00001100;
     PR2 = 255;            // Periodo 19.53kHz [cite: 364]
     T2CON = 0b00000000;   // Prescaler 1:1, Timer2 apagado
+
+#if MEDIR_TAREAS
+    // Timer1 libre de 16 bits (Fosc/4, 1:8 -> 1,6 us por cuenta, RD16) para los
+    // tiempos de las tareas
+    T1CON = 0b10110001;
+    PIE1bits.TMR1IE = 0;
+#endif
+
+    // Periféricos sin uso apagados (comparadores, referencia, HLVD)
+    CMCON = 0x07;
+    CVRCON = 0x00;
+    HLVDCON = 0x00;
 }
 
 // [cite: 368]
@@ -127,25 +182,585 @@ void inicializar_variables(void) {
     // Estados [cite: 435-436]
     ESTADO = 0; PREVIO = 0;
 
+    // Bajo consumo (T_WDT = 0 fuerza la calibración en la primera prueba)
+    T_WDT = 0; TMR0_BASE = 0;
+    T_ACTIVO = 0; T_DORMIDO = 0; F_SUENO = 0;
+
     // Limpieza matemática
     AARGB0 = 0; BARGB0 = 0; 
     
     // PID Init (Ahora activo según PDF)
     // 
     PidInitialize();
-    kp = 62;
-    ki = 54;
-    kd = 0;
+    kp_nom = 62;
+    ki_nom = 54;
+    kd_nom = 0;
+    I_FILT = 0;
+    TM_ADELANTO = 0;
+    TM_PENDIENTE = 0;
+    VBAT_AD = VBAT_NOM_CUENTAS;
+    VBAT_LEIDA = 0;
+    THD_X10 = 0;
+    CICLOS = 0;
+    EV_PERDIDOS = 0;
+#if TRAZA_MODO == TRAZA_SPI
+    TRAZA_ENTRA = 0; TRAZA_N = 0; TRAZA_PERDIDOS = 0;
+#endif
+#if PARALELO
+    REF_CAIDA = REF_ERR;
+    FASE_DIF = 0;
+    FASE_ATRASO = 0;
+    CAIDA_PASO = 0;
+    CAIDA_FASE = 0;
+    RETARDO_TICKS = 0;
+#endif
+#if SINCRONISMO == SINC_ESCLAVO
+    SINC_ERROR = 0;
+    SINC_ENGANCHE = 0;
+#endif
+#if COMANDOS_SPI
+    CMD_N = 0; CMD_POS = 0; CMD_PEDIDOS = 0;
+    CMD_VOLCADO_POS = EV_REGISTROS;
+    CMD_APLICADOS = 0; CMD_ERRORES = 0;
+    REF_REMOTA = 0;
+#endif
+#if RESUMEN
+    borrar_resumen();
+    RES_ESTADO_ANT = 0;
+    RES_NUMERO = 0;
+    RES_LISTO = 0;
+#endif
+#if MEDIR_TAREAS
+    {
+        uint8_t i;
+        for (i = 0; i < TAREAS; i++)
+            borrar_tarea(i);
+    }
+    HOLGURA_CERO = 0;
+    HIST_ENVIO = 0;
+#endif
+    AJUSTADO = 0;
+#if AUTOAJUSTE_PID
+    AUTO_INTENTADO = 0;
+#endif
+
+    // Bloque válido en la EEPROM: reemplaza los valores de arriba
+    cargar_parametros();
+    kp = kp_nom; ki = ki_nom; kd = kd_nom;
 }
 
 // [cite: 591-599]
-void leer_AD(uint8_t canal) {
-    LECTURA = 0;            // Marca inicio
-    ADCON0 = canal;         // Selecciona canal
+// Devuelve ADRESH. Con AD_SINCRONO la ISR también convierte (muestrear_ad()): se
+// espera, con interrupciones, a que recoja la suya en el tick siguiente y el A/D
+// se toma poniendo ADON, que la ISR respeta. El resultado se lee antes de
+// soltarlo, así una conversión de la ISR no lo pisa.
+uint8_t leer_AD(uint8_t canal) {
+    uint8_t d;
+
+    MARCA_LECTURA(0);       // Marca inicio
+#if AD_SINCRONO
+    INTCONbits.GIE = 0;
+    while (AD_ISR && T2CONbits.TMR2ON)
+    {
+        INTCONbits.GIE = 1;
+        NOP();
+        ESPERA_TICK();
+        INTCONbits.GIE = 0;
+    }
+    while (ADCON0bits.GO);  // Timer2 parado: la de la ISR se descarta
+    AD_ISR = 0;
+    ADCON0 = (uint8_t)((canal << 2) | 0x01);    // Canal + ADON
+    INTCONbits.GIE = 1;
+#else
+    ADCON0 = (uint8_t)(canal << 2); // Selecciona canal ANx (CHS3:CHS0)
     ADCON0bits.ADON = 1;    // Enciende ADC
+#endif
     _delay_us(3);           // Tiempo adquisición
     ADCON0bits.GO = 1;      // Inicia
     while(ADCON0bits.GO);   // Espera
+    d = ADRESH;
     ADCON0bits.ADON = 0;    // Apaga
-    LECTURA = 1;            // Marca fin
-}
\ No newline at end of file
+    MARCA_LECTURA(1);       // Marca fin
+    return d;
+}
+
+// --- EEPROM: ESCRITURA POR INTERRUPCIÓN Y REGISTRO DE EVENTOS ---
+
+#if REGISTRO_EVENTOS || PARAMETROS_EEPROM
+// 1 = hay una escritura en curso: el próximo byte lo lanza la ISR con EEIF. En 0
+// quien encola levanta EEIF por software para arrancar.
+static volatile uint8_t EE_OCUPADA;
+#endif
+
+#if PARAMETROS_EEPROM
+// Bloque a escribir por la ISR y próximo byte a comparar (PAR_BYTES = nada pendiente)
+static volatile uint8_t PAR_DATOS[PAR_BYTES];
+static volatile uint8_t PAR_BYTE = PAR_BYTES;
+#endif
+
+#if REGISTRO_EVENTOS
+// Cola de registros armados por el bucle principal y escritos por la ISR
+static volatile uint8_t EV_DATOS[EV_COLA][EV_BYTES];
+static volatile uint8_t EV_DIR[EV_COLA];    // Dirección de cada registro en la EEPROM
+static volatile uint8_t EV_ENTRA;           // Próximo lugar libre de la cola
+static volatile uint8_t EV_SALE;            // Registro que está escribiendo la ISR
+static volatile uint8_t EV_EN_COLA;         // Registros sin terminar de escribir
+static volatile uint8_t EV_BYTE;            // Escrituras del registro en curso ya iniciadas (EV_BYTES + 1)
+static uint8_t EV_PROXIMO;                  // Posición del anillo del próximo registro
+static uint8_t EV_SEQ_PROXIMA;
+
+static uint8_t siguiente_seq(uint8_t s) {
+    s++;
+    return (s == EV_SEQ_VACIA) ? 0 : s;
+}
+#endif
+
+// Lectura de un byte de la EEPROM de datos (un ciclo de instrucción)
+uint8_t leer_eeprom(uint8_t dir) {
+    EEADR = dir;
+    EECON1bits.EEPGD = 0;   // Memoria de datos
+    EECON1bits.CFGS = 0;
+    EECON1bits.RD = 1;
+    return EEDATA;
+}
+
+// Lo mismo con el inversor en marcha: EEADR es compartido con eeprom_isr(), así
+// que espera (con interrupciones) a que no haya una escritura en curso y lee con
+// GIE en 0 para que la ISR no empiece otra en el medio
+uint8_t leer_eeprom_en_marcha(uint8_t dir) {
+    uint8_t d;
+
+    INTCONbits.GIE = 0;
+    while (EECON1bits.WR)
+    {
+        INTCONbits.GIE = 1;
+        NOP();
+        INTCONbits.GIE = 0;
+    }
+    d = leer_eeprom(dir);
+    INTCONbits.GIE = 1;
+    return d;
+}
+
+// 1 = hay una escritura en curso o encolada: leer_eeprom_en_marcha() esperaría
+uint8_t eeprom_ocupada(void) {
+#if REGISTRO_EVENTOS || PARAMETROS_EEPROM
+    return EE_OCUPADA;
+#else
+    return 0;
+#endif
+}
+
+// Al arrancar: ubica el próximo registro siguiendo la cadena de secuencias desde
+// la posición 0 (corta en la primera que no sigue: ahí está el más viejo o una
+// posición vacía) y deja el arranque en el registro. La posición 0 vacía con la 1
+// escrita es un registro cortado después de dar la vuelta: la cadena sigue desde
+// la 1 y el próximo vuelve a ser el 0.
+void inicializar_registro(void) {
+#if REGISTRO_EVENTOS
+    uint8_t i;
+    uint8_t s;
+    uint8_t ant;
+
+    EV_PROXIMO = 0;
+    EV_SEQ_PROXIMA = 0;
+    i = 1;
+    ant = leer_eeprom(EV_BASE + EV_SEQ);
+    if (ant == EV_SEQ_VACIA)
+    {
+        ant = leer_eeprom(EV_BASE + EV_BYTES + EV_SEQ);
+        i = 2;
+    }
+    if (ant != EV_SEQ_VACIA)
+    {
+        for (; i < EV_REGISTROS; i++)
+        {
+            s = leer_eeprom(EV_BASE + i * EV_BYTES + EV_SEQ);
+            if (s != siguiente_seq(ant))
+                break;
+            ant = s;
+        }
+        EV_PROXIMO = (i == EV_REGISTROS) ? 0 : i;
+        EV_SEQ_PROXIMA = siguiente_seq(ant);
+    }
+
+    EV_ENTRA = 0;
+    EV_SALE = 0;
+    EV_EN_COLA = 0;
+    EV_BYTE = 0;
+    PIR2bits.EEIF = 0;
+    PIE2bits.EEIE = 1;
+    registrar_evento(EV_ARRANQUE);
+#endif
+}
+
+// Encola un registro con el estado actual. Sin escritura en curso levanta EEIF por
+// software: la ISR arranca la escritura. Sin lugar, se cuenta en EV_PERDIDOS.
+void registrar_evento(uint8_t tipo) {
+#if REGISTRO_EVENTOS
+    volatile uint8_t *r;
+    uint32_t c;
+
+    if (EV_EN_COLA >= EV_COLA)
+    {
+        if (EV_PERDIDOS < 255)
+            EV_PERDIDOS++;
+        return;
+    }
+
+    PIE1bits.TMR2IE = 0;
+    c = CICLOS;
+    PIE1bits.TMR2IE = 1;
+
+    r = EV_DATOS[EV_ENTRA];
+    r[EV_SEQ] = EV_SEQ_PROXIMA;
+    r[EV_TIPO] = tipo;
+    r[EV_CICLOS] = (uint8_t)(c >> 24);
+    r[EV_CICLOS + 1] = (uint8_t)(c >> 16);
+    r[EV_CICLOS + 2] = (uint8_t)(c >> 8);
+    r[EV_CICLOS + 3] = (uint8_t)c;
+    r[EV_I_SALIDA] = I_SALIDA;
+    r[EV_T_DISIP] = T_DISIP;
+    r[EV_T_TRAFO] = T_TRAFO;
+    r[EV_V_SALIDA] = V_SALIDA;
+    EV_DIR[EV_ENTRA] = (uint8_t)(EV_BASE + EV_PROXIMO * EV_BYTES);
+
+    EV_ENTRA = (EV_ENTRA + 1 == EV_COLA) ? 0 : EV_ENTRA + 1;
+    EV_PROXIMO = (EV_PROXIMO + 1 == EV_REGISTROS) ? 0 : EV_PROXIMO + 1;
+    EV_SEQ_PROXIMA = siguiente_seq(EV_SEQ_PROXIMA);
+
+    PIE2bits.EEIE = 0;
+    EV_EN_COLA++;
+    if (!EE_OCUPADA)
+        PIR2bits.EEIF = 1;
+    PIE2bits.EEIE = 1;
+#endif
+}
+
+#if REGISTRO_EVENTOS || PARAMETROS_EEPROM
+// Lanza la escritura de un byte. GIE ya está en 0 dentro de la ISR, como pide la
+// secuencia 0x55/0xAA.
+static void escribir_eeprom(uint8_t dir, uint8_t dato) {
+    EEADR = dir;
+    EEDATA = dato;
+    EECON1bits.EEPGD = 0;
+    EECON1bits.CFGS = 0;
+    EECON1bits.WREN = 1;
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    EE_OCUPADA = 1;
+}
+#endif
+
+// Desde la ISR con EEIF: terminó el byte anterior (o la patada de quien encoló).
+// Primero los registros de eventos: la secuencia en EV_SEQ_VACIA, los bytes
+// 1..EV_BYTES-1 y la secuencia nueva al final (un corte en el medio deja la
+// posición vacía, no un registro viejo con datos nuevos). Después el bloque de
+// parámetros, salteando los bytes que ya tienen el valor.
+void eeprom_isr(void) {
+#if REGISTRO_EVENTOS || PARAMETROS_EEPROM
+    uint8_t j;
+
+    PIR2bits.EEIF = 0;
+    EE_OCUPADA = 0;
+#if REGISTRO_EVENTOS
+    if (EV_BYTE == EV_BYTES + 1)
+    {
+        // Registro completo
+        EV_BYTE = 0;
+        EV_SALE = (EV_SALE + 1 == EV_COLA) ? 0 : EV_SALE + 1;
+        EV_EN_COLA--;
+    }
+    if (EV_EN_COLA)
+    {
+        if (EV_BYTE == 0)
+        {
+            escribir_eeprom(EV_DIR[EV_SALE] + EV_SEQ, EV_SEQ_VACIA);
+        }
+        else
+        {
+            j = (EV_BYTE == EV_BYTES) ? EV_SEQ : EV_BYTE;
+            escribir_eeprom(EV_DIR[EV_SALE] + j, EV_DATOS[EV_SALE][j]);
+        }
+        EV_BYTE++;
+        return;
+    }
+#endif
+#if PARAMETROS_EEPROM
+    while (PAR_BYTE < PAR_BYTES)
+    {
+        j = PAR_BYTE++;
+        EEADR = PAR_BASE + j;           // En línea: leer_eeprom() es del bucle principal
+        EECON1bits.EEPGD = 0;
+        EECON1bits.CFGS = 0;
+        EECON1bits.RD = 1;
+        if (EEDATA != PAR_DATOS[j])
+        {
+            escribir_eeprom(PAR_BASE + j, PAR_DATOS[j]);
+            return;
+        }
+    }
+#endif
+    EECON1bits.WREN = 0;
+#else
+    PIR2bits.EEIF = 0;
+#endif
+}
+
+// --- PARÁMETROS EN EEPROM ---
+
+#if PARAMETROS_EEPROM || COMANDOS_SPI
+// Variables del bloque, en el orden de la EEPROM (opciones.h)
+static volatile uint8_t * const PAR_VARIABLES[PAR_CANTIDAD] = {
+    &kp_nom, &ki_nom, &kd_nom, &REF0, &REF1, &V_MAX_0, &V_MAX_1, &I_MAX, &PP_MAX,
+    &T_DISIP1, &T_DISIP2, &HIS_DIS1, &HIS_DIS2, &T_TRAFO1, &T_TRAFO2,
+    &HIS_TRA1, &HIS_TRA2, &AA, &C_MAXIMA, &AJUSTADO
+};
+#endif
+
+#if COMANDOS_SPI
+// CMD_PARAMETRO: escribe una variable del bloque. Las ganancias nominales pasan
+// también a las activas (sin PROGRAMA_GANANCIAS nadie más las copia)
+uint8_t escribir_parametro(uint8_t indice, uint8_t valor) {
+    if (indice >= PAR_CANTIDAD)
+        return 0;
+    *PAR_VARIABLES[indice] = valor;
+    if (indice < 3)
+    {
+        kp = kp_nom;
+        ki = ki_nom;
+        kd = kd_nom;
+    }
+    return 1;
+}
+#endif
+
+#if PARAMETROS_EEPROM
+// CRC-16 CCITT (x^16 + x^12 + x^5 + 1) por byte, sin tabla
+static uint16_t crc16(uint16_t crc, uint8_t dato) {
+    uint8_t x;
+
+    x = (uint8_t)(crc >> 8) ^ dato;
+    x ^= x >> 4;
+    return (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+}
+#endif
+
+// Al arrancar, desde inicializar_variables(): lee el bloque entero a RAM y, si la
+// versión y el CRC coinciden, reemplaza los valores compilados
+void cargar_parametros(void) {
+#if PARAMETROS_EEPROM
+    uint8_t b[PAR_BYTES];
+    uint8_t i;
+    uint16_t crc = 0xFFFF;
+
+    PAR_CARGADOS = 0;
+    EEADR = PAR_BASE;
+    EECON1bits.EEPGD = 0;
+    EECON1bits.CFGS = 0;
+    for (i = 0; i < PAR_BYTES; i++)
+    {
+        EECON1bits.RD = 1;
+        b[i] = EEDATA;
+        EEADR++;
+    }
+
+    if (b[0] != PAR_VERSION)
+        return;
+    for (i = 0; i < PAR_BYTES - 2; i++)
+        crc = crc16(crc, b[i]);
+    if (crc != (((uint16_t)b[PAR_BYTES - 2] << 8) | b[PAR_BYTES - 1]))
+        return;
+
+    for (i = 0; i < PAR_CANTIDAD; i++)
+        *PAR_VARIABLES[i] = b[i + 1];
+    PAR_CARGADOS = 1;
+#else
+    PAR_CARGADOS = 0;
+#endif
+}
+
+// Guarda los valores actuales de RAM. Vuelve enseguida: la ISR escribe los bytes
+// que cambiaron (~4 ms cada uno) cuando termina lo que haya del registro de
+// eventos. Un pedido durante una escritura la reinicia con los valores nuevos.
+void guardar_parametros(void) {
+#if PARAMETROS_EEPROM
+    uint8_t i;
+    uint16_t crc = 0xFFFF;
+
+    PIE2bits.EEIE = 0;
+    PAR_DATOS[0] = PAR_VERSION;
+    crc = crc16(crc, PAR_VERSION);
+    for (i = 0; i < PAR_CANTIDAD; i++)
+    {
+        PAR_DATOS[i + 1] = *PAR_VARIABLES[i];
+        crc = crc16(crc, PAR_DATOS[i + 1]);
+    }
+    PAR_DATOS[PAR_BYTES - 2] = (uint8_t)(crc >> 8);
+    PAR_DATOS[PAR_BYTES - 1] = (uint8_t)crc;
+    PAR_BYTE = 0;
+    if (!EE_OCUPADA)
+        PIR2bits.EEIF = 1;
+    PIE2bits.EEIE = 1;
+#endif
+}
+
+// --- LÍNEA DE TIEMPO DEL ARRANQUE ---
+
+// Guarda Timer0 al terminar una fase. Solo la primera vez: los rearranques
+// después de apagar() no pisan las marcas del arranque desde el reset.
+void marcar_arranque(uint8_t fase) {
+    uint16_t t;
+
+    if (ARR_MARCAS & (1 << fase))
+        return;
+    t = TMR0L;                      // Leer L primero: latchea TMR0H
+    t |= (uint16_t)TMR0H << 8;
+    T_ARRANQUE[fase] = t;
+    ARR_MARCAS |= (uint8_t)(1 << fase);
+}
+
+// --- TIEMPOS DE LAS TAREAS ---
+
+#if MEDIR_TAREAS
+uint16_t leer_timer1(void) {
+    uint16_t t;
+
+    t = TMR1L;                      // Con RD16, leer L latchea TMR1H
+    t |= (uint16_t)TMR1H << 8;
+    return t;
+}
+
+// Suma al histograma de la tarea el tiempo desde 'desde' y devuelve la lectura
+// de Timer1, que es el comienzo de la tarea siguiente
+uint16_t medir_tarea(uint8_t tarea, uint16_t desde) {
+    uint16_t ahora;
+    uint16_t t;
+    uint8_t b;
+
+    ahora = leer_timer1();
+    t = ahora - desde;
+    if (t < HIST_MIN[tarea])
+        HIST_MIN[tarea] = t;
+    if (t > HIST_MAX[tarea])
+        HIST_MAX[tarea] = t;
+
+    // Cubeta: cantidad de bits significativos de t >> HIST_DESPL
+    t >>= HIST_DESPL;
+    for (b = 0; t && b < HIST_CUBETAS - 1; b++)
+        t >>= 1;
+    if (HIST_CUENTAS[tarea][b] < 0xFFFF)
+        HIST_CUENTAS[tarea][b]++;
+    return ahora;
+}
+
+void borrar_tarea(uint8_t tarea) {
+    uint8_t b;
+
+    HIST_MIN[tarea] = 0xFFFF;
+    HIST_MAX[tarea] = 0;
+    for (b = 0; b < HIST_CUBETAS; b++)
+        HIST_CUENTAS[tarea][b] = 0;
+}
+#endif
+
+// --- BAJO CONSUMO ---
+
+// Suma a T_ACTIVO el tiempo despierto desde la última lectura de Timer0.
+// Timer0 se detiene en SLEEP, así que solo cuenta tiempo con el oscilador en marcha.
+void contar_activo(void) {
+    uint16_t t;
+
+    t = TMR0L;                      // Leer L primero: latchea TMR0H
+    t |= (uint16_t)TMR0H << 8;
+    T_ACTIVO += (uint16_t)(t - TMR0_BASE);
+    TMR0_BASE = t;
+}
+
+// Mide un período del WDT contra el cristal. En modo IDLE el Timer0 sigue
+// contando y el desborde del WDT despierta al micro sin resetearlo.
+void calibrar_wdt(void) {
+    uint16_t t0, t1;
+    uint8_t gie = INTCONbits.GIE;
+
+    INTCONbits.GIE = 0;
+    PIR1bits.TMR2IF = 0;
+    OSCCONbits.IDLEN = 1;           // SLEEP entra en IDLE
+    t0 = TMR0L;
+    t0 |= (uint16_t)TMR0H << 8;
+    WDTCONbits.SWDTEN = 1;
+    SLEEP();                        // SLEEP borra el WDT: el período arranca acá
+    NOP();
+    WDTCONbits.SWDTEN = 0;
+    t1 = TMR0L;
+    t1 |= (uint16_t)TMR0H << 8;
+    t1 -= t0;
+
+    // Si despertó por otra causa, se queda con el valor nominal
+    if (t1 < (WDT_PERIODO_NOM / 2) || t1 > (WDT_PERIODO_NOM * 2))
+        t1 = WDT_PERIODO_NOM;
+    T_WDT = t1;
+    INTCONbits.GIE = gie;
+}
+
+// Sueño profundo durante un período del WDT. Despierta antes si cambia
+// el estado del FF de protección (INT0); AHORRO se revisa en cada despertar.
+void dormir(void) {
+    uint8_t gie = INTCONbits.GIE;
+
+    contar_activo();                // Cierra el tramo despierto
+    INTCONbits.GIE = 0;             // Despertar sin saltar a la ISR
+    ADCON0 = 0x00;                  // ADC apagado
+    MARCA_LECTURA(0);
+    OSCCONbits.IDLEN = 0;           // SLEEP = sueño profundo: CPU y reloj detenidos
+
+    WDTCONbits.SWDTEN = 1;
+    SLEEP();
+    NOP();
+    WDTCONbits.SWDTEN = 0;
+
+    if (INTCONbits.INT0IF)
+    {
+        // Despertó por cambio de pin: se estima medio período dormido.
+        // INT0IF queda pendiente para que la ISR atienda la falla.
+        T_DORMIDO += T_WDT >> 1;
+    }
+    else
+    {
+        T_DORMIDO += T_WDT;
+    }
+    INTCONbits.GIE = gie;
+}
+
+// Espera el fin del ciclo de 50 Hz en modo IDLE: la CPU queda detenida
+// y cada interrupción de Timer2 (o INT0) la despierta para revisar K.
+void esperar_ciclo_idle(void) {
+    OSCCONbits.IDLEN = 1;
+    while (K < 2 && !FALLA_ACTIVA)
+    {
+        SLEEP();
+        NOP();
+    }
+}
+
+// Calcula F_SUENO (fracción dormida, 255 = 100 %) y reinicia los acumuladores
+void reporte_sueno(void) {
+    uint32_t activo, dormido;
+
+    contar_activo();
+    activo = T_ACTIVO;
+    dormido = T_DORMIDO;
+
+    // Escala para que dormido * 255 no desborde 32 bits
+    while ((activo + dormido) > 0x00FFFFFFUL)
+    {
+        activo >>= 1;
+        dormido >>= 1;
+    }
+    if ((activo + dormido) != 0)
+        F_SUENO = (uint8_t)((dormido * 255UL) / (activo + dormido));
+
+    T_ACTIVO = 0;
+    T_DORMIDO = 0;
+}
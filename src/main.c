@@ -37,6 +37,108 @@ volatile uint8_t pidStat2;
 volatile uint8_t percent_err;
 volatile uint8_t error0; // Añadida por contexto del PID
 volatile uint8_t error1;
+volatile uint8_t kp, ki, kd;
+volatile uint8_t AJUSTADO;
+#if AUTOAJUSTE_PID
+volatile uint8_t AUTO_INTENTADO;
+#endif
+volatile uint8_t kp_nom, ki_nom, kd_nom;
+volatile uint8_t a_Error0, a_Error1, a_Error2;
+volatile uint8_t p_Error0, p_Error1;
+volatile uint8_t d_Error0, d_Error1;
+volatile uint8_t prop0, prop1, prop2;
+volatile uint8_t integ0, integ1, integ2;
+volatile uint8_t deriv0, deriv1, deriv2;
+volatile uint8_t pidOut0, pidOut1, pidOut2;
+volatile uint8_t derivCount;
+
+// Control repetitivo
+#if REPETITIVO
+volatile int16_t CORRECCION[PUNTOS_SENO];
+volatile int8_t ERROR_REP[PUNTOS_SENO];
+#endif
+volatile uint8_t REP_INDICE;
+volatile uint8_t TM_ADELANTO;
+volatile uint8_t TM_PENDIENTE;
+volatile uint16_t ISR_TCY;
+volatile int8_t OBS_V;
+volatile uint8_t OBS_I_ANT;
+volatile uint8_t OBS_SIN_REF;
+volatile uint8_t PID_TRAMO;
+volatile uint8_t VBAT_AD;
+volatile uint8_t VBAT_LEIDA;
+volatile uint8_t V_SINC;
+volatile uint8_t I_SINC;
+volatile uint8_t AD_LISTO;
+#if AD_SINCRONO
+volatile uint8_t AD_ISR;
+#endif
+#if THD_GOERTZEL
+volatile int32_t THD_S1[THD_BINS];
+volatile int32_t THD_S2[THD_BINS];
+#endif
+volatile uint8_t THD_J;
+volatile uint8_t THD_N;
+volatile uint8_t THD_FIN;
+volatile uint8_t THD_X10;
+volatile uint32_t CICLOS;
+volatile uint8_t EV_PERDIDOS;
+volatile uint8_t PAR_CARGADOS;
+volatile uint16_t T_ARRANQUE[ARR_FASES];
+volatile uint8_t ARR_MARCAS;
+volatile uint8_t ARR_ENVIADA;
+#if TRAZA_MODO == TRAZA_SPI
+volatile uint8_t TRAZA_BUF[TRAZA_REGISTROS][3];
+volatile uint8_t TRAZA_ENTRA;
+volatile uint8_t TRAZA_N;
+volatile uint8_t TRAZA_PERDIDOS;
+#endif
+#if MEDIR_TAREAS
+volatile uint16_t HIST_MIN[TAREAS];
+volatile uint16_t HIST_MAX[TAREAS];
+volatile uint16_t HIST_CUENTAS[TAREAS][HIST_CUBETAS];
+volatile uint16_t T_TAREA;
+volatile uint16_t T_CICLO;
+volatile uint8_t HOLGURA_CERO;
+volatile uint8_t HIST_ENVIO;
+#endif
+#if RESUMEN
+volatile uint8_t RES_MIN[RES_VARIABLES];
+volatile uint8_t RES_MAX[RES_VARIABLES];
+volatile uint32_t RES_SUMA[RES_VARIABLES];
+volatile uint16_t RES_CUENTAS[RES_CUBETAS];
+volatile uint16_t RES_SOBRE_DIS;
+volatile uint16_t RES_SOBRE_TRA;
+volatile uint8_t RES_ENTRADAS[8];
+volatile uint8_t RES_ESTADO_ANT;
+volatile uint16_t RES_CICLOS;
+volatile uint8_t RES_NUMERO;
+volatile uint8_t RES_TRAMA[RESUMEN_BYTES];
+volatile uint8_t RES_LISTO;
+#endif
+#if PARALELO
+volatile uint8_t REF_CAIDA;
+volatile int16_t FASE_DIF;
+volatile uint16_t FASE_ATRASO;
+volatile uint8_t CAIDA_PASO;
+volatile uint16_t CAIDA_FASE;
+volatile uint8_t RETARDO_TICKS;
+#endif
+#if SINCRONISMO == SINC_ESCLAVO
+volatile int16_t SINC_ERROR;
+volatile uint8_t SINC_ENGANCHE;
+#endif
+#if COMANDOS_SPI
+volatile uint8_t CMD_BUF[CMD_COLA][3];
+volatile uint8_t CMD_N;
+volatile uint8_t CMD_RX[4];
+volatile uint8_t CMD_POS;
+volatile uint8_t CMD_APLICADOS;
+volatile uint8_t CMD_ERRORES;
+volatile uint8_t CMD_PEDIDOS;
+volatile uint8_t CMD_VOLCADO_POS;
+volatile uint8_t REF_REMOTA;
+#endif
 
 // Protección y Medición
 volatile uint8_t CUENTA;
@@ -48,6 +150,7 @@ volatile uint8_t I_MAX;
 volatile uint8_t I_PICO;
 volatile uint8_t PP;
 volatile uint8_t PP_MAX;
+volatile uint16_t I_FILT;
 
 // Térmico
 volatile uint8_t T_DISIP;
@@ -65,8 +168,15 @@ volatile uint8_t HIS_TRA2;
 volatile uint8_t PREVIO;
 volatile uint8_t ESTADO;
 
+// Bajo consumo
+volatile uint16_t T_WDT;
+volatile uint16_t TMR0_BASE;
+volatile uint32_t T_ACTIVO;
+volatile uint32_t T_DORMIDO;
+volatile uint8_t F_SUENO;
+
 // Matemáticas y Temporales
-volatile uint8_t AARGB0; volatile uint8_t AARGB1; volatile uint8_t AARGB2; volatile uint8_t AARGB3;
+volatile uint8_t AARGB0; volatile uint8_t AARGB1; volatile uint8_t AARGB2; volatile uint8_t AARGB3; volatile uint8_t AARGB4;
 volatile uint8_t BARGB0; volatile uint8_t BARGB1; volatile uint8_t BARGB2; volatile uint8_t BARGB3;
 volatile uint8_t TEMPW; volatile uint8_t TEMPST;
 volatile uint8_t TEMP_A0; volatile uint8_t TEMP_A1;
@@ -79,24 +189,42 @@ volatile uint8_t TEMP_B0; volatile uint8_t TEMP_B1;
  */
 void main(void) {
     // Inicialización del sistema [cite: 457-463]
+    inicializar_timer0();   // Primero: base de tiempo de las marcas del arranque
     inicializar_pines();
     inicializar_puertos();
+#if ARRANQUE_RAPIDO
+    // El reset del FF corre mientras se configura el resto
+    PORTCbits.RC0 = 0;
+    PORTBbits.RB1 = 1;
+#endif
     inicializar_adc();
     inicializar_interrupciones();
     inicializar_spi();
     inicializar_pwm_timer2();
+    marcar_arranque(ARR_PERIFERICOS);
     inicializar_variables();
+    inicializar_registro();
+    marcar_arranque(ARR_VARIABLES);
 
     while (1) { // [cite: 464]
         // Inicialización de seguridad [cite: 466-470]
         PORTCbits.RC0 = 0;      // Garantiza Q del FF = 0
         PORTBbits.RB1 = 1;      // Reset del flip-flop U14
-        while (PORTCbits.RC6 == 0); // Espera a que el hardware confirme reset
+        while (FALLA_HW == 0) ESPERA_TICK(); // Espera a que el hardware confirme reset
         PORTBbits.RB1 = 0;      // Libera reset del FF
+        marcar_arranque(ARR_FF);
 
         // Lectura referencia de tensión [cite: 472-473]
-        leer_AD(3); // AN3
-        REF_ERR = ADRESH;
+#if COMANDOS_SPI
+        if (!REF_REMOTA)
+#endif
+        {
+            REF_ERR = leer_AD(3); // AN3
+        }
+#if PARALELO
+        REF_CAIDA = REF_ERR;    // Sin caída hasta el primer I_SALIDA
+#endif
+        marcar_arranque(ARR_REF);
 
         // Preparación para encendido [cite: 475-477]
         TEMPO = V_MAX_0;
@@ -104,33 +232,87 @@ void main(void) {
         encender(); // Arranque suave
 
         if (PREVIO & (1 << 7)) { // ¿Salió por sobrecarga? [cite: 478]
+            registrar_falla();
             apagar();
             continue;
         }
 
+#if AUTOAJUSTE_PID
+        // Puesta en marcha: ganancias medidas con el relé. Si una protección
+        // corta la prueba se apaga y se repite al volver a encender; sin medición
+        // sigue con las ganancias compiladas y AJUSTADO en 0: AUTO_INTENTADO (solo
+        // en RAM) evita repetirla en cada apagar() y la próxima vez es después de
+        // un reset
+        if (!AJUSTADO && !AUTO_INTENTADO) {
+            if (autoajuste()) {
+                AJUSTADO = 1;
+                guardar_parametros();   // El próximo arranque no repite la prueba
+            } else if (FALLA_HW == 0 || FALLA_ACTIVA || (PREVIO & ((1 << 1) | (1 << 3) | (1 << 5)))
+                       || (ESTADO & (1 << 5))) {
+                registrar_falla();
+                apagar();
+                continue;
+            } else {
+                AUTO_INTENTADO = 1;
+            }
+        }
+#endif
+
         // Inicio del ciclo principal [cite: 483]
         NN = 1;
 
         while (1) { // [cite: 486]
-            SYNC_OSC = 1;
-            LECTURA = 1;
-            K = 0;
-            SYNC_OSC = 0;
+            MARCA_CICLO(1);
+            MARCA_LECTURA(1);
+            K &= 0x01;  // Nuevo ciclo; tras un atraso queda el semiciclo en curso (pwm.c)
+            MARCA_CICLO(0);
+            TRAZA(TP_CICLO);
+#if COMANDOS_SPI
+            if (CMD_N)
+                aplicar_comandos(); // Lo recibido en las tramas del ciclo anterior
+#endif
+#if MEDIR_TAREAS
+            TAREA_INICIO();
+            T_CICLO = T_TAREA;
+#endif
             
-            V_PICO_0 = TEMPO;
-            V_PICO_1 = TEMP1;
+            cargar_v_pico(); // TEMPO:TEMP1 + batería y carga
+            TAREA_FIN(TAREA_V_PICO);
 
             // Lectura de tensión de salida [cite: 495]
-            leer_AD(0); // AN0
-            V_SALIDA = ADRESH;
+#if !REPETITIVO
+#if AD_SINCRONO
+            if (AD_LISTO & AD_LISTO_V) {
+                V_SALIDA = V_SINC;  // Pico del semiciclo anterior, tomado por la ISR
+                AD_LISTO &= ~AD_LISTO_V;
+            } else
+#endif
+            {
+                V_SALIDA = leer_AD(0); // AN0
+            }
+#endif
+            TAREA_FIN(TAREA_AD_V);
 
             pid();      // Lazo de control [cite: 497]
+#if PID_POR_CICLO > 1
+            PID_TRAMO = 1;  // Las demás actualizaciones, en la espera del fin de ciclo
+#endif
+            TAREA_FIN(TAREA_PID);
             i_salida(); // Protección por corriente [cite: 498]
+            TAREA_FIN(TAREA_I_SALIDA);
+            programar_ganancias(); // Ganancias del próximo ciclo según la carga
+            compensar_tm(); // Fase de la corriente para el tiempo muerto
+            observador_carga(); // Escalón de carga: corrige V_PICO en este ciclo
+#if PARALELO
+            caida_paralelo();   // Referencia y frecuencia del próximo ciclo
+#endif
+            TAREA_FIN(TAREA_AJUSTES);
             
             if (PREVIO & (1 << 1)) // [cite: 498]
                 break;
 
             temperat(); // Protección térmica [cite: 500]
+            TAREA_FIN(TAREA_TEMPERAT);
             if ((PREVIO & (1 << 3)) || (PREVIO & (1 << 5))) // [cite: 501]
                 break;
 
@@ -141,17 +323,20 @@ void main(void) {
             } else {
                 ESTADO &= ~(1 << 5);
             }
+            TAREA_FIN(TAREA_BATERIA);
+#if RESUMEN
+            acumular_resumen(); // También los ciclos que terminan en Bajo Consumo
+#endif
 
             // Bajo consumo [cite: 513]
             if (AHORRO) {
                 ESTADO |= (1 << 0);
-                leer_AD(8); // AN8
-                I_MINIMA = ADRESH;
+                I_MINIMA = leer_AD(8); // AN8
 
                 if (I_SALIDA < I_MINIMA) { // [cite: 518]
                     ESTADO |= (1 << 1); // Entró en bajo consumo
-                    LECTURA = 0;
-                    while (K != 2); // Espera fin del ciclo de 50 Hz
+                    MARCA_LECTURA(0);
+                    esperar_ciclo_idle(); // Espera fin del ciclo de 50 Hz con la CPU detenida
 
                     // Prueba de carga [cite: 525]
                     prueba();
@@ -164,18 +349,63 @@ void main(void) {
             } else {
                 ESTADO &= ~(1 << 0); // [cite: 534]
             }
+#if COMANDOS_SPI
+            if (CMD_PEDIDOS & (1 << CMD_PRUEBA)) { // Prueba de carga pedida por el display
+                CMD_PEDIDOS &= ~(1 << CMD_PRUEBA);
+                MARCA_LECTURA(0);
+                esperar_ciclo_idle();
+                prueba();
+                TEMPO = V_MAX_0;
+                TEMP1 = V_MAX_1;
+                continue;
+            }
+#endif
+            TAREA_FIN(TAREA_AHORRO);
 
-            LECTURA = 0;
+#if MEDIR_TAREAS
+            medir_tarea(TAREA_OCUPADO, T_CICLO);
+            if (K >= 2 && HOLGURA_CERO < 0xFF)
+                HOLGURA_CERO++;     // El trabajo se comió todo el ciclo: la espera no espera
+#endif
+            MARCA_LECTURA(0);
+#if RESUMEN
+            if (RES_LISTO)
+                enviar();   // ~1 ms a Fosc/64, dentro de la holgura del ciclo
+#elif TELEMETRIA || COMANDOS_SPI || THD_GOERTZEL || TRAZA_MODO == TRAZA_SPI || MEDIR_TAREAS \
+    || SINCRONISMO == SINC_ESCLAVO || MEDIR_ISR
+            enviar();       // Trama cruda (con COMANDOS_SPI también trae los comandos)
+#else
+            if (!ARR_ENVIADA)
+                enviar();   // Sin telemetría: una sola trama, la de la línea de tiempo del arranque
+#endif
             // Espera fin del ciclo de 50 Hz [cite: 538]
-            while (K != 2) {
+            while (K < 2 && !FALLA_ACTIVA) {
                 // Protección hardware externa [cite: 540]
-                if (PORTCbits.RC6 == 0)
+                if (FALLA_HW == 0)
                     break;
+#if REPETITIVO
+                repetitivo(); // Muestra de AN0 en cada índice de la tabla
+#endif
+#if PREALIM_VBAT
+                medir_vbat(); // Batería para el próximo ciclo
+#endif
+#if THD_GOERTZEL
+                medir_thd(); // Armónicos de la salida
+#endif
+#if PID_POR_CICLO > 1
+                pid_intermedio(); // PID multitasa
+#endif
+                ESPERA_TICK();
             }
-            if (PORTCbits.RC6 == 0) break; // Salida del while si hubo fallo
+            TAREA_FIN(TAREA_HOLGURA);
+            if (FALLA_HW == 0) break; // Salida del while si hubo fallo
         }
 
         // Apagado del inversor [cite: 544]
+#if RESUMEN
+        contar_estados();
+#endif
+        registrar_falla();
         apagar();
         TEMPO = V_MAX_0;
         TEMP1 = V_MAX_1;
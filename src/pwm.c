@@ -9,15 +9,49 @@
 #include <xc.h>
 
 // --- Tabla de Senos (Reconstruida para el proyecto) ---
-// Valores escalados para corresponder con la lógica del PDF
-const uint16_t SINE_TABLE[98] = {
-    0, 25, 50, 75, 100, 125, 150, 175, 199, 223, 247, 271, 294, 317, 340, 362, 384, 405, 426, 447,
-    467, 487, 506, 525, 543, 560, 577, 593, 609, 624, 638, 652, 665, 677, 689, 700, 710, 720, 729, 737,
-    744, 751, 757, 762, 766, 770, 773, 775, 776, 776, 775, 773, 770, 766, 762, 757, 751, 744, 737, 729,
-    720, 710, 700, 689, 677, 665, 652, 638, 624, 609, 593, 577, 560, 543, 525, 506, 487, 467, 447, 426,
-    405, 384, 362, 340, 317, 294, 271, 247, 223, 199, 175, 150, 125, 100, 75, 50, 25, 0
+// Medio ciclo en Q14 (16384 = 1.0): ccpr1() hace V_PICO * SENO >> 14,
+// así V_PICO queda directamente en cuentas de duty de 10 bits.
+const uint16_t SINE_TABLE[PUNTOS_SENO] = {
+    0, 531, 1061, 1589, 2117, 2642, 3164, 3683, 4198, 4708, 5214, 5714, 6209, 6696,
+    7177, 7650, 8115, 8572, 9020, 9458, 9886, 10304, 10711, 11107, 11491, 11863, 12223, 12570,
+    12904, 13224, 13530, 13822, 14100, 14363, 14610, 14843, 15060, 15261, 15446, 15615, 15767, 15903,
+    16022, 16125, 16210, 16279, 16330, 16365, 16382, 16382, 16365, 16330, 16279, 16210, 16125, 16022,
+    15903, 15767, 15615, 15446, 15261, 15060, 14843, 14610, 14363, 14100, 13822, 13530, 13224, 12904,
+    12570, 12223, 11863, 11491, 11107, 10711, 10304, 9886, 9458, 9020, 8572, 8115, 7650, 7177,
+    6696, 6209, 5714, 5214, 4708, 4198, 3683, 3164, 2642, 2117, 1589, 1061, 531, 0
 };
 
+#if COMPENSA_TM
+// --- Compensación de tiempo muerto ---
+// Pérdida de duty según la fase de la corriente del puente (mismos 98 índices que
+// SINE_TABLE): TM_CUENTAS x sen(fase), para pendiente 1. Cerca del cruce por cero
+// la corriente queda dentro del rizado, la rama conmuta en parte con la corriente
+// a favor y la pérdida baja; ccpr1() escala por TM_PENDIENTE (corriente pico /
+// rizado) y satura en TM_PLENO, así la rampa se angosta con la carga.
+#if MODULACION == MOD_UNIPOLAR
+#define TM_RAMAS    2       // Conmutan las dos ramas
+#else
+#define TM_RAMAS    1
+#endif
+#define TM(q6)      ((uint8_t)((TM_CUENTAS * TM_RAMAS * (q6) + 32) / 64))
+#define TM_PLENO    TM(64)
+
+static const uint8_t COMP_TM[PUNTOS_SENO] = {
+    TM(0), TM(2), TM(4), TM(6), TM(8), TM(10), TM(12), TM(14), TM(16), TM(18), TM(20), TM(22), TM(24), TM(26),
+    TM(28), TM(30), TM(31), TM(33), TM(35), TM(37), TM(38), TM(40), TM(41), TM(43), TM(45), TM(46), TM(47), TM(49),
+    TM(50), TM(51), TM(52), TM(54), TM(55), TM(56), TM(57), TM(58), TM(59), TM(59), TM(60), TM(61), TM(61), TM(62),
+    TM(62), TM(63), TM(63), TM(63), TM(64), TM(64), TM(64), TM(64), TM(64), TM(64), TM(64), TM(63), TM(63), TM(63),
+    TM(62), TM(62), TM(61), TM(61), TM(60), TM(59), TM(59), TM(58), TM(57), TM(56), TM(55), TM(54), TM(52), TM(51),
+    TM(50), TM(49), TM(47), TM(46), TM(45), TM(43), TM(41), TM(40), TM(38), TM(37), TM(35), TM(33), TM(31), TM(30),
+    TM(28), TM(26), TM(24), TM(22), TM(20), TM(18), TM(16), TM(14), TM(12), TM(10), TM(8), TM(6), TM(4), TM(2)
+};
+#endif
+
+#if DITHER_BITS
+#define DITHER_MASCARA  ((1 << DITHER_BITS) - 1)
+static uint8_t RESTO_DUTY;      // Acumulador del sigma-delta (solo la ISR)
+#endif
+
 // Implementación de funciones faltantes en PDF 
 uint8_t leeseno0(void) {
     // Retorna parte alta del valor de tabla
@@ -31,22 +65,163 @@ uint8_t leeseno1(void) {
     return (uint8_t)(val & 0xFF);
 }
 
+#if PARALELO
+// Caída de frecuencia con resolución de fracción de tick: cada tick suma
+// CAIDA_PASO a CAIDA_FASE y el acarreo es un tick entero que el contador de la
+// tabla agrega al cambiar de punto. Mientras tanto el seno se interpola hacia el
+// punto anterior por el atraso pendiente (un punto = 2 ticks = 512/256), así la
+// fase baja de a poco y no en saltos de 51,2 us (~0,9°, varios A de corriente
+// entre unidades con el filtro de 3 mH). En el primer punto no se interpola.
+static uint16_t ATRASO;         // Atraso del seno en 1/256 de tick (solo la ISR)
+
+static void atrasar_seno(void) {
+    uint16_t f;
+    uint16_t a, b;
+    uint32_t x;
+
+    f = CAIDA_FASE + CAIDA_PASO;
+    if (f < CAIDA_FASE) RETARDO_TICKS++;
+    CAIDA_FASE = f;
+    ATRASO = ((uint16_t)RETARDO_TICKS << 8) + (f >> 8);
+    if (ATRASO > 511) ATRASO = 511;
+    if (CICLO_0 == 0)
+        return;
+
+    a = SINE_TABLE[CICLO_0];
+    b = SINE_TABLE[CICLO_0 - 1];
+    if (b > a) x = a + (((uint32_t)(b - a) * ATRASO) >> 9);
+    else x = a - (((uint32_t)(a - b) * ATRASO) >> 9);
+    SENO_0 = (uint8_t)(x >> 8);
+    SENO_1 = (uint8_t)(x & 0xFF);
+}
+#endif
+
+#if SINCRONISMO == SINC_ESCLAVO
+// Posición de la tabla, en ticks desde el inicio del ciclo, que corresponde al
+// flanco del maestro: lo pone al pasar a su punto 0 y esta ISR lo ve en su tick
+// siguiente.
+#define SINC_OBJETIVO   ((SINC_DESFASE + 1) % TICKS_CICLO)
+
+static uint8_t SINC_ANTERIOR;   // SYNC_ENTRADA en el tick anterior (solo la ISR)
+static int8_t AJUSTE_SINC;      // Ticks por corregir: > 0 atrasa, < 0 adelanta (solo la ISR)
+
+// En cada flanco de subida del maestro: error de fase en ticks, llevado a ±medio
+// ciclo. Fuera de la banda se corrige todo; el primer flanco que cae dentro
+// corrige el resto y después se deja estar hasta que vuelva a salir.
+static void seguir_maestro(void) {
+    int16_t e;
+
+    if (!SYNC_ENTRADA) {
+        SINC_ANTERIOR = 0;
+        return;
+    }
+    if (SINC_ANTERIOR)
+        return;
+    SINC_ANTERIOR = 1;
+
+    e = (int16_t)CICLO_0 * 2 + NN - 1 - SINC_OBJETIVO;
+    if (K & 0x01)
+        e += PUNTOS_SENO * 2;
+    if (e >= TICKS_CICLO / 2)
+        e -= TICKS_CICLO;
+    else if (e < -(TICKS_CICLO / 2))
+        e += TICKS_CICLO;
+    SINC_ERROR = e;
+
+    if (e > SINC_BANDA || e < -SINC_BANDA)
+        SINC_ENGANCHE = 0;
+    else if (SINC_ENGANCHE < 255)
+        SINC_ENGANCHE++;
+    if (SINC_ENGANCHE > 1)
+        AJUSTE_SINC = 0;
+    else if (e > 127)
+        AJUSTE_SINC = 127;
+    else if (e < -127)
+        AJUSTE_SINC = -127;
+    else
+        AJUSTE_SINC = (int8_t)e;
+}
+
+// Desde encender(), con Timer2 parado: el pulso que ya está en la línea al
+// arrancar no cuenta como flanco
+void borrar_sincronismo(void) {
+    SINC_ANTERIOR = 1;
+    AJUSTE_SINC = 0;
+    SINC_ERROR = 0;
+    SINC_ENGANCHE = 0;
+}
+#endif
+
 // [cite: 1140-1153]
 void ccpr1(void) {
     uint32_t producto;
     uint16_t duty10;
     
     // Multiplicación 16x16: V_PICO * SENO
-    producto = ((uint16_t)V_PICO_0 << 8 | V_PICO_1) * ((uint16_t)SENO_0 << 8 | SENO_1);
+    producto = (uint32_t)((uint16_t)V_PICO_0 << 8 | V_PICO_1) * ((uint16_t)SENO_0 << 8 | SENO_1);
     
     // División por 16384 (>>14)
     duty10 = (uint16_t)(producto >> 14); 
+
+#if DITHER_BITS
+    // Sigma-delta: suma los bits que caen debajo del LSB y, al desbordar,
+    // adelanta una cuenta de duty en este tick. Los bits 13..8 del producto
+    // están en su segundo byte: un corrimiento de 8 bits en lugar de 32.
+    RESTO_DUTY += ((uint8_t)(producto >> 8) >> (6 - DITHER_BITS)) & DITHER_MASCARA;
+    if (RESTO_DUTY > DITHER_MASCARA) {
+        RESTO_DUTY &= DITHER_MASCARA;
+        if (duty10 < 1023) duty10++;
+    }
+#endif
+
+#if REPETITIVO || COMPENSA_TM
+    {
+        int16_t d = (int16_t)duty10;
+#if REPETITIVO
+        // Corrección aprendida para este punto de la tabla
+        d += CORRECCION[CICLO_0] / 16;
+#endif
+#if COMPENSA_TM
+        // Tiempo muerto: la corriente va TM_ADELANTO índices adelante de la
+        // tensión; pasado su cruce por cero el signo se invierte
+        {
+            uint8_t f = CICLO_0 + TM_ADELANTO;
+            uint8_t c;
+            uint16_t x;
+            if (f < PUNTOS_SENO) c = COMP_TM[f]; else c = COMP_TM[f - PUNTOS_SENO];
+            x = ((uint16_t)c * TM_PENDIENTE) >> 4;
+            c = (x > TM_PLENO) ? TM_PLENO : (uint8_t)x;
+            if (f < PUNTOS_SENO) d += c; else d -= c;
+        }
+#endif
+        if (d < 0) d = 0;
+        if (d > 1023) d = 1023;
+        duty10 = (uint16_t)d;
+    }
+#endif
     
+#if MODULACION == MOD_UNIPOLAR
+    // Referencias complementarias alrededor de 511: la rama que lleva el
+    // semiciclo sube duty/2 y la otra baja duty/2 (el bit impar va a la alta),
+    // así d1 - d2 = duty10 exacto, igual que en el modo por semiciclo.
+    {
+        uint16_t alta = 511 + ((duty10 + 1) >> 1);
+        uint16_t baja = 511 - (duty10 >> 1);
+
+        if (K & 0x01) { uint16_t t = alta; alta = baja; baja = t; }
+
+        CCPR1L = (uint8_t)(alta >> 2);
+        CCP1CONbits.DC1B = (uint8_t)(alta & 0x03);
+        CCPR2L = (uint8_t)(baja >> 2);
+        CCP2CONbits.DC2B = (uint8_t)(baja & 0x03);
+    }
+#else
     // Cargar PWM CCP1
     CCPR1L = (uint8_t)(duty10 >> 2); 
     
     if ((duty10 >> 1) & 0x01) CCP1CONbits.DC1B1 = 1; else CCP1CONbits.DC1B1 = 0;
     if (duty10 & 0x01)        CCP1CONbits.DC1B0 = 1; else CCP1CONbits.DC1B0 = 0;
+#endif
 }
 
 // [cite: 1104-1138]
@@ -54,17 +229,21 @@ void calculos_sinusoide(void) {
     // Leer seno
     SENO_0 = leeseno0(); // Llama a nuestra implementación
     SENO_1 = leeseno1();
+#if PARALELO
+    atrasar_seno();
+#endif
     
     // Calcular duty
     ccpr1();
-    
+
+#if MODULACION == MOD_SEMICICLO
     // Copiar duty a CCP2
     CCPR2L = CCPR1L;
     if (CCP1CONbits.DC1B1) CCP2CONbits.DC2B1 = 1; else CCP2CONbits.DC2B1 = 0;
     if (CCP1CONbits.DC1B0) CCP2CONbits.DC2B0 = 1; else CCP2CONbits.DC2B0 = 0;
 
-    // Selección de rama
-    if (K == 0) { 
+    // Selección de rama (K par = primer semiciclo)
+    if ((K & 0x01) == 0) { 
         // Apagar PWM2
         CCPR2L = 0;
         CCP2CONbits.DC2B1 = 0;
@@ -75,33 +254,223 @@ void calculos_sinusoide(void) {
         CCP1CONbits.DC1B1 = 0;
         CCP1CONbits.DC1B0 = 0;
     }
+#endif
+}
+
+#if AD_SINCRONO
+#if PARALELO
+static uint16_t AD_ATRASO;      // ATRASO al arrancar la muestra de fase
+static uint8_t FASE_PRIMERA;    // Ya está la muestra de FASE_INDICE de este ciclo
+#endif
+
+// Desde la ISR, al empezar un índice de la tabla: si es uno de los de AD_INDICE_*
+// (o de FASE_INDICE con PARALELO) arranca la conversión del canal y recoger_ad()
+// la lee en el tick siguiente. La adquisición la hace el A/D al poner GO (ACQT,
+// ver inicializar_adc()), así que la ISR no espera nada. Si el bucle principal
+// está en leer_AD() (ADON) no se le corta la conversión: la muestra se pierde y
+// main() usa su propia lectura.
+static void muestrear_ad(void) {
+    uint8_t canal = 0;
+    uint8_t tipo;
+
+#if PARALELO
+    if ((K & 0x01) && CICLO_0 == FASE_INDICE)
+        tipo = AD_ISR_FASE1;
+    else if ((K & 0x01) && CICLO_0 == PUNTOS_SENO - FASE_INDICE)
+        tipo = AD_ISR_FASE2;
+    else
+#endif
+#if !REPETITIVO
+    if (CICLO_0 == AD_INDICE_V && (K & 0x01))
+        tipo = AD_ISR_V;
+    else
+#endif
+    if (CICLO_0 == AD_INDICE_I1 || CICLO_0 == AD_INDICE_I2)
+    {
+        tipo = AD_ISR_I;
+        canal = 1;
+    }
+    else
+        return;
+
+    if (ADCON0bits.ADON || AD_ISR)
+        return;                     // A/D del bucle principal
+    ADCON0 = (uint8_t)((canal << 2) | 0x01);    // Canal + ADON
+    ADCON0bits.GO = 1;              // Tacq automática y conversión (~12 us)
+    AD_ISR = tipo;
+#if PARALELO
+    AD_ATRASO = ATRASO;
+#endif
 }
 
+// Al empezar cada tick: la conversión que arrancó muestrear_ad() en el anterior
+// ya terminó. Guarda la muestra y suelta el A/D (ADON en 0) para leer_AD().
+static void recoger_ad(void) {
+    uint8_t tipo = AD_ISR;
+    uint8_t m;
+#if PARALELO
+    uint8_t m_bajo;
+#endif
+
+    if (tipo == 0 || ADCON0bits.GO)
+        return;
+    m = ADRESH;
+#if PARALELO
+    m_bajo = ADRESL;
+#endif
+    ADCON0 = 0;
+    AD_ISR = 0;
+
+#if PARALELO
+    // Ángulo del bus (caida_paralelo()): las dos muestras en 10 bits; sin la
+    // primera la segunda no sirve
+    if (tipo == AD_ISR_FASE1 || tipo == AD_ISR_FASE2)
+    {
+        int16_t x = (int16_t)(((uint16_t)m << 2) | (m_bajo >> 6));
+
+        if (tipo == AD_ISR_FASE1)
+        {
+            FASE_DIF = -x;
+            FASE_ATRASO = AD_ATRASO;
+            FASE_PRIMERA = 1;
+        }
+        else if (FASE_PRIMERA)
+        {
+            FASE_DIF += x;
+            FASE_ATRASO += AD_ATRASO;
+            AD_LISTO |= AD_LISTO_FASE;
+            FASE_PRIMERA = 0;
+        }
+        return;
+    }
+#endif
+    if (tipo == AD_ISR_V)
+    {
+        V_SINC = m;
+        AD_LISTO |= AD_LISTO_V;
+    }
+    else
+    {
+        if (m > I_SINC)
+            I_SINC = m;
+        AD_LISTO |= AD_LISTO_I;
+    }
+}
+#endif
+
 // ISR del Timer 2 [cite: 549-589]
 void __interrupt() isr(void) {
+    // Falla de hardware (INT0): corte inmediato antes que cualquier otra fuente.
+    // Deshabilitar los CCP lleva RC1/RC2 al latch (0) sin esperar el fin del
+    // período PWM; CCPRxL solo se actualiza en el próximo desborde de Timer2.
+    if (INTCONbits.INT0IF) {
+        CCP1CON = 0;
+        CCP2CON = 0;
+        CCPR1L = 0;
+        CCPR2L = 0;
+        T2CONbits.TMR2ON = 0;
+        PIR1bits.TMR2IF = 0;        // Descarta el tick pendiente
+        INTCONbits.INT0IF = 0;
+        ESTADO |= (1 << 6);         // Protección hardware activa
+        PREVIO |= (1 << 7);         // Forzar apagado total
+    }
+
     if (PIR1bits.TMR2IF) {
         PIR1bits.TMR2IF = 0;
+#if TRAZA_CON_ISR
+        TRAZA_ISR(TP_ISR);
+#endif
         
         // Salvado de contexto MANUAL (tal cual PDF)
         TEMPW = WREG;
         TEMPST = STATUS;
         
+#if AD_SINCRONO
+        recoger_ad();               // Muestra arrancada en el tick anterior
+#endif
+
         // Generación
         calculos_sinusoide();
 
-        // Contadores
+        // Contadores: cada punto de la tabla dura 2 ticks (NN = 1, 2), así
+        // 98 puntos x 2 x 51,2 us = 10 ms por semiciclo (50 Hz)
         NN++;
-        CICLO_0++; 
-        // Lógica de control de tabla (no explícita en PDF, agregada para funcionamiento)
-        if (CICLO_0 >= 98) {
-             CICLO_0 = 0;
-             K++;
-             if (K >= 2) K = 0;
-             NN = 1; 
+#if PARALELO
+        if (NN > 2 && RETARDO_TICKS) {
+            RETARDO_TICKS--;        // Caída de frecuencia: el punto dura un tick más
+            NN = 2;                 // (ver atrasar_seno())
+        } else
+#endif
+        if (NN > 2) {
+            NN = 1;
+            CICLO_0++; 
+            // Lógica de control de tabla (no explícita en PDF, agregada para funcionamiento)
+            // K llega a 2 al completar el ciclo y main() le borra el bit 1 (while (K < 2)).
+            // Si el bucle principal se pasa del ciclo K queda en 2-3 con la paridad
+            // del semiciclo en curso: la espera termina en el acto y la rama sigue bien.
+            if (CICLO_0 >= PUNTOS_SENO) {
+                 CICLO_0 = 0;
+                 K++;
+                 if (K > 3)
+                     K = 2;
+                 if ((K & 0x01) == 0)
+                     CICLOS++;      // Ciclo de 50 Hz completo
+            }
+#if SINCRONISMO == SINC_ESCLAVO
+            // Corrección de fase: el punto que empieza dura 3 ticks o 1
+            if (AJUSTE_SINC && (CICLO_0 & 0x03) == 0) {
+                if (AJUSTE_SINC > 0) {
+                    AJUSTE_SINC--;
+                    NN = 0;
+                } else {
+                    AJUSTE_SINC++;
+                    NN = 2;
+                }
+            }
+#endif
+#if AD_SINCRONO
+            muestrear_ad();         // Lecturas en fase fija con la tabla
+#endif
+        }
+
+#if SINCRONISMO == SINC_MAESTRO
+        // Pulso de inicio de ciclo para los esclavos: los dos primeros puntos
+        if ((K & 0x01) == 0 && CICLO_0 < 2) SYNC_OSC = 1; else SYNC_OSC = 0;
+#elif SINCRONISMO == SINC_ESCLAVO
+        seguir_maestro();
+#endif
+
+#if MEDIR_ISR
+        // Timer2 a 1:1 cuenta Tcy desde el inicio del período: su valor aquí es
+        // latencia + contexto + generación + contadores, en ciclos de instrucción.
+        // Si TMR2IF volvió a subir, Timer2 dio la vuelta (PR2 = 255): 256 más. El
+        // flag se lee antes y después de TMR2 por si la vuelta cae entre los dos.
+        {
+            uint8_t vuelta = PIR1bits.TMR2IF;
+            uint16_t t = TMR2;
+
+            if (!vuelta && PIR1bits.TMR2IF)
+            {
+                vuelta = 1;
+                t = TMR2;
+            }
+            if (vuelta)
+                t += 256;
+            if (t > ISR_TCY) ISR_TCY = t;
         }
+#endif
+#if TRAZA_CON_ISR
+        TRAZA_ISR(TP_ISR_FIN);
+#endif
 
         // Restauración
         WREG = TEMPW;
         STATUS = TEMPST;
     }
+
+#if REGISTRO_EVENTOS || PARAMETROS_EEPROM
+    // Fin de escritura de la EEPROM: próximo byte del registro o de los parámetros
+    if (PIE2bits.EEIE && PIR2bits.EEIF)
+        eeprom_isr();
+#endif
 }
\ No newline at end of file